@@ -0,0 +1,261 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host micro benchmarks of the wake cycle hot paths, one JSON object per
+ * run on the standard output:
+ *
+ *   {"benchmarks": [{"name": ..., "iterations": ..., "samples": ...,
+ *     "ns_per_op": ..., "ns_per_sample": ..., "bytes_per_sample": ...}]}
+ *
+ * The names, the order, the inputs and the iteration counts are fixed so
+ * the runs of two commits compare line by line. bytes_per_sample is 0
+ * where nothing is encoded. "bench quick" runs 1/100 of the iterations.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "esp_log.h"
+
+#include "bmp280_calib.h"
+#include "compress.h"
+#include "event_log.h"
+#include "host.h"
+#include "sample_buf.h"
+#include "sdkconfig.h"
+#include "upload.h"
+
+
+#define SAMPLES CONFIG_SAMPLE_BUF_SIZE
+
+/* in the buffers of the encoders */
+#define BODY_SIZE 16384
+
+typedef struct {
+	const char *name;
+	void (*fn)(void);
+	int iterations;
+	int samples;		/* per call of fn */
+} bench_t;
+
+static int64_t s_ns;		/* timed by fn when it times itself */
+static size_t s_bytes;		/* encoded by fn */
+static volatile uint32_t s_sink;
+static FILE *s_console;		/* the UART of the formatted log */
+
+/* the datasheet example for the calibration read */
+static const host_bmp280_t s_sensor = { 27504, 26435, -1000, 36477, -10685,
+    3024, 2855, 140, -7, 15500, -14600, 6000, 519888, 415148 };
+
+static uint32_t s_time[SAMPLES];
+static float s_value[SAMPLES][SAMPLE_FIELDS];
+static bool s_keep[SAMPLES];
+static char s_body[BODY_SIZE];
+
+
+static int64_t now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* a minute cadence of a slow drift with a noise of the sensor resolution */
+static void inputs()
+{
+	srand(1);
+	for (int i = 0; i < SAMPLES; i++) {
+		s_time[i] = 1700000000 + i * 60;
+		s_value[i][SAMPLE_TEMP] = 21.5 + sinf(i / 8.0) +
+		    (rand() % 5) * 0.01;
+		s_value[i][SAMPLE_PRES] = 1013.25 + i * 0.02 +
+		    (rand() % 5) * 0.01;
+	}
+}
+
+static void fill()
+{
+	sample_buf_drop(sample_buf_count());
+	for (int i = 0; i < SAMPLES; i++) {
+		sample_buf_push(s_time[i], s_value[i], 0);
+	}
+}
+
+static void bench_encode_line()
+{
+	size_t len = 0;
+
+	for (int i = 0; i < SAMPLES; i++) {
+		for (int f = 0; f < SAMPLE_FIELDS; f++) {
+			upload_encode_line(s_body, BODY_SIZE, &len, f,
+			    sample_buf_get(i));
+		}
+	}
+	s_bytes += len;
+}
+
+static void bench_format_float()
+{
+	char buf[32];
+
+	for (int i = 0; i < SAMPLES; i++) {
+		s_bytes += snprintf(buf, sizeof(buf), "%0.2f",
+		    s_value[i][SAMPLE_PRES]);
+	}
+}
+
+static void bench_sample_buf()
+{
+	for (int i = 0; i < SAMPLES; i++) {
+		sample_buf_push(s_time[i], s_value[i], 0);
+	}
+	sample_buf_drop(sample_buf_count());
+}
+
+/* every push past the full buffer merges the oldest buckets */
+static void bench_sample_buf_full()
+{
+	for (int i = 0; i < SAMPLES; i++) {
+		sample_buf_push(s_time[i], s_value[i], 0);
+	}
+}
+
+static void bench_compress()
+{
+	float v[SAMPLES];
+
+	for (int i = 0; i < SAMPLES; i++) {
+		v[i] = s_value[i][SAMPLE_TEMP];
+	}
+	s_sink += compress_sdt(s_time, v, SAMPLES,
+	    CONFIG_COMPRESS_TEMP_ERR / 100.0, s_keep);
+}
+
+static void bench_bmp280_calib()
+{
+	s_sink += bmp280_calib_t_diff(CONFIG_BMP_CALIB_TDIFF) +
+	    bmp280_calib_p_diff(CONFIG_BMP_CALIB_PDIFF);
+}
+
+/* one record into the binary ring in the RTC arena */
+static void bench_event_log()
+{
+	event_log(EV_POST, SAMPLES, 1234);
+}
+
+/* the same event formatted and printed like ESP_LOGI() does */
+static void bench_event_format()
+{
+	static const char *format[EV_MAX] = {
+#define EVENT(id, format) [id] = format,
+		EVENTS
+#undef EVENT
+	};
+	char line[96];
+
+	snprintf(line, sizeof(line), format[EV_POST], SAMPLES, 1234);
+	s_bytes += fprintf(s_console, "I (%u) %s: %s\n",
+	    esp_log_timestamp(), "event_log", line);
+}
+
+static esp_err_t post(const char *data, size_t len, int n)
+{
+	s_bytes += len;
+
+	return ESP_OK;
+}
+
+/* the request bodies of a full buffer, the refill is not timed */
+static void bench_request()
+{
+	int64_t start;
+
+	fill();
+	start = now_ns();
+	upload_send(post, INT64_MAX, true);
+	s_ns += now_ns() - start;
+}
+
+static const bench_t s_bench[] = {
+	{ "encode_line", bench_encode_line, 20000, SAMPLES },
+	{ "format_float", bench_format_float, 20000, SAMPLES },
+	{ "sample_buf_push_drop", bench_sample_buf, 20000, SAMPLES },
+	{ "sample_buf_push_full", bench_sample_buf_full, 20000, SAMPLES },
+	{ "compress_sdt", bench_compress, 20000, SAMPLES },
+	{ "bmp280_calib_diff", bench_bmp280_calib, 200000, 1 },
+	{ "event_log", bench_event_log, 200000, 1 },
+	{ "event_log_format", bench_event_format, 200000, 1 },
+	{ "upload_request", bench_request, 5000, SAMPLES },
+};
+
+int main(int argc, char **argv)
+{
+	int scale = argc > 1 && strcmp(argv[1], "quick") == 0 ? 100 : 1;
+	int n = sizeof(s_bench) / sizeof(s_bench[0]);
+
+	inputs();
+	host_bmp280(CONFIG_BMP_ADDR, &s_sensor);
+	CHECK(bmp280_calib_read() == ESP_OK);
+	s_console = fopen("/dev/null", "w");
+	CHECK(s_console != NULL);
+
+	printf("{\"benchmarks\": [\n");
+	for (int i = 0; i < n; i++) {
+		const bench_t *b = &s_bench[i];
+		int iterations = b->iterations / scale;
+		int64_t start;
+		int64_t ns;
+
+		fill();
+		s_ns = 0;
+		s_bytes = 0;
+		start = now_ns();
+		for (int j = 0; j < iterations; j++) {
+			b->fn();
+		}
+		ns = s_ns != 0 ? s_ns : now_ns() - start;
+
+		printf("  {\"name\": \"%s\", \"iterations\": %d, "
+		    "\"samples\": %d, \"ns_per_op\": %.1f, "
+		    "\"ns_per_sample\": %.1f, \"bytes_per_sample\": %.1f}%s\n",
+		    b->name, iterations, b->samples,
+		    (double)ns / iterations,
+		    (double)ns / iterations / b->samples,
+		    (double)s_bytes / iterations / b->samples,
+		    i + 1 < n ? "," : "");
+	}
+	printf("]}\n");
+
+	return 0;
+}
@@ -0,0 +1,78 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host stand-in of the ESP-IDF driver/i2c.h, the device is the emulated
+ * BMP280 of host_bmp280().
+ */
+
+#ifndef DRIVER_I2C_H
+#define DRIVER_I2C_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+typedef int i2c_port_t;
+
+#define I2C_NUM_0 0
+
+typedef enum {
+	I2C_MODE_SLAVE,
+	I2C_MODE_MASTER
+} i2c_mode_t;
+
+typedef enum {
+	GPIO_PULLUP_DISABLE,
+	GPIO_PULLUP_ENABLE
+} gpio_pullup_t;
+
+typedef struct {
+	i2c_mode_t mode;
+	int sda_io_num;
+	int scl_io_num;
+	gpio_pullup_t sda_pullup_en;
+	gpio_pullup_t scl_pullup_en;
+	struct {
+		uint32_t clk_speed;
+	} master;
+} i2c_config_t;
+
+esp_err_t i2c_param_config(i2c_port_t port, const i2c_config_t *conf);
+esp_err_t i2c_driver_install(i2c_port_t port, i2c_mode_t mode,
+    size_t slv_rx_buf_len, size_t slv_tx_buf_len, int intr_alloc_flags);
+esp_err_t i2c_driver_delete(i2c_port_t port);
+esp_err_t i2c_master_write_read_device(i2c_port_t port, uint8_t addr,
+    const uint8_t *write_buffer, size_t write_size, uint8_t *read_buffer,
+    size_t read_size, TickType_t ticks_to_wait);
+esp_err_t i2c_master_write_to_device(i2c_port_t port, uint8_t addr,
+    const uint8_t *write_buffer, size_t write_size,
+    TickType_t ticks_to_wait);
+
+#endif /* DRIVER_I2C_H */
@@ -0,0 +1,91 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Host stand-in of the ESP-IDF driver/uart.h, the test provides the port.
+ */
+
+#ifndef DRIVER_UART_H
+#define DRIVER_UART_H
+
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+typedef int uart_port_t;
+
+/* of freertos/queue.h */
+typedef void *QueueHandle_t;
+
+typedef enum {
+	UART_DATA_5_BITS,
+	UART_DATA_6_BITS,
+	UART_DATA_7_BITS,
+	UART_DATA_8_BITS
+} uart_word_length_t;
+
+typedef enum {
+	UART_PARITY_DISABLE,
+	UART_PARITY_EVEN = 2,
+	UART_PARITY_ODD
+} uart_parity_t;
+
+typedef enum {
+	UART_STOP_BITS_1 = 1,
+	UART_STOP_BITS_1_5,
+	UART_STOP_BITS_2
+} uart_stop_bits_t;
+
+typedef enum {
+	UART_HW_FLOWCTRL_DISABLE,
+	UART_HW_FLOWCTRL_RTS,
+	UART_HW_FLOWCTRL_CTS,
+	UART_HW_FLOWCTRL_CTS_RTS
+} uart_hw_flowcontrol_t;
+
+typedef struct {
+	int baud_rate;
+	uart_word_length_t data_bits;
+	uart_parity_t parity;
+	uart_stop_bits_t stop_bits;
+	uart_hw_flowcontrol_t flow_ctrl;
+} uart_config_t;
+
+#define UART_PIN_NO_CHANGE (-1)
+
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size,
+    int tx_buffer_size, int queue_size, QueueHandle_t *uart_queue,
+    int intr_alloc_flags);
+esp_err_t uart_driver_delete(uart_port_t uart_num);
+esp_err_t uart_param_config(uart_port_t uart_num,
+    const uart_config_t *uart_config);
+esp_err_t uart_set_pin(uart_port_t uart_num, int tx_io_num, int rx_io_num,
+    int rts_io_num, int cts_io_num);
+int uart_write_bytes(uart_port_t uart_num, const void *src, size_t size);
+esp_err_t uart_wait_tx_done(uart_port_t uart_num, TickType_t ticks_to_wait);
+
+#endif /* DRIVER_UART_H */
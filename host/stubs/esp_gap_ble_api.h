@@ -0,0 +1,111 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host stand-in of the ESP-IDF esp_gap_ble_api.h, the advertising part.
+ * The emulated controller of host.c completes the requests at once and
+ * records them in host_ble().
+ */
+
+#ifndef ESP_GAP_BLE_API_H
+#define ESP_GAP_BLE_API_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#define ESP_BLE_AD_TYPE_FLAG 0x01
+#define ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE 0xff
+
+#define ESP_BLE_ADV_FLAG_GEN_DISC (0x01 << 1)
+#define ESP_BLE_ADV_FLAG_BREDR_NOT_SPT (0x01 << 2)
+
+typedef enum {
+	ESP_BT_STATUS_SUCCESS = 0,
+	ESP_BT_STATUS_FAIL,
+} esp_bt_status_t;
+
+typedef enum {
+	ADV_TYPE_IND = 0x00,
+	ADV_TYPE_DIRECT_IND_HIGH = 0x01,
+	ADV_TYPE_SCAN_IND = 0x02,
+	ADV_TYPE_NONCONN_IND = 0x03,
+} esp_ble_adv_type_t;
+
+typedef enum {
+	BLE_ADDR_TYPE_PUBLIC = 0x00,
+	BLE_ADDR_TYPE_RANDOM = 0x01,
+} esp_ble_addr_type_t;
+
+typedef enum {
+	ADV_CHNL_37 = 0x01,
+	ADV_CHNL_38 = 0x02,
+	ADV_CHNL_39 = 0x04,
+	ADV_CHNL_ALL = 0x07,
+} esp_ble_adv_channel_t;
+
+typedef enum {
+	ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY = 0x00,
+} esp_ble_adv_filter_t;
+
+typedef struct {
+	uint16_t adv_int_min;		/* 0.625ms units */
+	uint16_t adv_int_max;
+	esp_ble_adv_type_t adv_type;
+	esp_ble_addr_type_t own_addr_type;
+	esp_ble_adv_channel_t channel_map;
+	esp_ble_adv_filter_t adv_filter_policy;
+} esp_ble_adv_params_t;
+
+typedef enum {
+	ESP_GAP_BLE_ADV_DATA_RAW_SET_COMPLETE_EVT = 4,
+	ESP_GAP_BLE_ADV_START_COMPLETE_EVT = 6,
+	ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT = 17,
+} esp_gap_ble_cb_event_t;
+
+typedef union {
+	struct {
+		esp_bt_status_t status;
+	} adv_data_raw_cmpl;
+	struct {
+		esp_bt_status_t status;
+	} adv_start_cmpl;
+	struct {
+		esp_bt_status_t status;
+	} adv_stop_cmpl;
+} esp_ble_gap_cb_param_t;
+
+typedef void (*esp_gap_ble_cb_t)(esp_gap_ble_cb_event_t event,
+    esp_ble_gap_cb_param_t *param);
+
+esp_err_t esp_ble_gap_register_callback(esp_gap_ble_cb_t callback);
+esp_err_t esp_ble_gap_config_adv_data_raw(uint8_t *raw_data,
+    uint32_t raw_data_len);
+esp_err_t esp_ble_gap_start_advertising(esp_ble_adv_params_t *adv_params);
+esp_err_t esp_ble_gap_stop_advertising(void);
+
+#endif /* ESP_GAP_BLE_API_H */
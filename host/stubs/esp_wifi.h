@@ -0,0 +1,50 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host stand-in of the ESP-IDF esp_wifi.h, the disconnect reasons only.
+ */
+
+#ifndef ESP_WIFI_H
+#define ESP_WIFI_H
+
+typedef enum {
+	WIFI_REASON_UNSPECIFIED = 1,
+	WIFI_REASON_AUTH_EXPIRE = 2,
+	WIFI_REASON_ASSOC_LEAVE = 8,
+	WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT = 15,
+	WIFI_REASON_802_1X_AUTH_FAILED = 23,
+	WIFI_REASON_BEACON_TIMEOUT = 200,
+	WIFI_REASON_NO_AP_FOUND = 201,
+	WIFI_REASON_AUTH_FAIL = 202,
+	WIFI_REASON_ASSOC_FAIL = 203,
+	WIFI_REASON_HANDSHAKE_TIMEOUT = 204,
+	WIFI_REASON_CONNECTION_FAIL = 205,
+} wifi_err_reason_t;
+
+#endif /* ESP_WIFI_H */
@@ -0,0 +1,777 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "esp_bt.h"
+#include "esp_bt_main.h"
+#include "esp_err.h"
+#include "esp_gap_ble_api.h"
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+
+#include "host.h"
+
+
+/* the RTC_NOINIT_ATTR variables, the linker provides the bounds */
+extern uint8_t __start_rtc_noinit[] __attribute__((weak));
+extern uint8_t __stop_rtc_noinit[] __attribute__((weak));
+
+#define RTC_MAX 16384
+
+#define NVS_ENTRIES 16
+#define NVS_NAME 16
+#define NVS_BLOB 256
+
+#define BOUNDARIES 1024
+#define LOG_WATCH 64
+
+/* one key of the emulated flash */
+typedef struct {
+	char ns[NVS_NAME];
+	char key[NVS_NAME];
+	size_t len;		/* 0 erased */
+	uint8_t data[NVS_BLOB];
+} host_nvs_t;
+
+/* survives the boots */
+typedef struct {
+	int64_t clock;
+	int64_t boot;
+	esp_reset_reason_t reason;
+	uint64_t timer;
+	uint8_t rtc[RTC_MAX];
+	host_nvs_t nvs[NVS_ENTRIES];
+	host_ble_t ble;
+	int cut;
+	int boundaries;
+	const char *kind[BOUNDARIES];	/* literals, same in every boot */
+	char watch[LOG_WATCH];
+	int hits;
+} host_state_t;
+
+static host_state_t *s_host = NULL;
+
+
+void *host_shared(size_t size)
+{
+	void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+	if (p == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+
+	return p;
+}
+
+static host_state_t *host()
+{
+	if (s_host == NULL) {
+		s_host = host_shared(sizeof(*s_host));
+		/* any time after the clock is valid */
+		s_host->clock = 1700000000LL * 1000000;
+	}
+
+	return s_host;
+}
+
+/* before main, the state is shared with all the boots */
+__attribute__((constructor)) static void host_init()
+{
+	host();
+}
+
+static size_t rtc_size()
+{
+	size_t size = __stop_rtc_noinit - __start_rtc_noinit;
+
+	if (size > RTC_MAX) {
+		fprintf(stderr, "RTC memory %zu over %d\n", size, RTC_MAX);
+		exit(1);
+	}
+
+	return size;
+}
+
+uint8_t *host_rtc(size_t *size)
+{
+	*size = rtc_size();
+
+	return host()->rtc;
+}
+
+void host_power_off()
+{
+	/* the content after the power on is random, not zero */
+	for (size_t i = 0; i < RTC_MAX; i++) {
+		host()->rtc[i] = rand();
+	}
+}
+
+static void rtc_save()
+{
+	if (rtc_size() > 0) {
+		memcpy(host()->rtc, __start_rtc_noinit, rtc_size());
+	}
+}
+
+int host_boot(esp_reset_reason_t reason, int (*fn)(void *), void *arg)
+{
+	pid_t pid;
+	int status;
+
+	host()->reason = reason;
+	host()->boot = host()->clock;
+	host()->boundaries = 0;
+
+	fflush(stdout);
+	fflush(stderr);
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		exit(1);
+	}
+
+	if (pid == 0) {
+		if (rtc_size() > 0) {
+			memcpy(__start_rtc_noinit, host()->rtc, rtc_size());
+		}
+		status = fn(arg);
+		rtc_save();
+		fflush(stdout);
+		_exit(status);
+	}
+
+	if (waitpid(pid, &status, 0) < 0) {
+		perror("waitpid");
+		exit(1);
+	}
+	host()->cut = 0;
+
+	if (WIFSIGNALED(status)) {
+		return 128 + WTERMSIG(status);
+	}
+
+	return WEXITSTATUS(status);
+}
+
+void host_cut()
+{
+	rtc_save();
+	fflush(stdout);
+	_exit(HOST_CUT);
+}
+
+void host_boundary(const char *kind)
+{
+	int n = ++host()->boundaries;
+
+	if (n <= BOUNDARIES) {
+		host()->kind[n - 1] = kind;
+	}
+
+	if (n == host()->cut) {
+		host_cut();
+	}
+}
+
+void host_cut_at(int n)
+{
+	host()->cut = n;
+}
+
+int host_boundaries()
+{
+	return host()->boundaries;
+}
+
+const char *host_boundary_kind(int i)
+{
+	if (i < 1 || i > host()->boundaries || i > BOUNDARIES) {
+		return "?";
+	}
+
+	return host()->kind[i - 1];
+}
+
+void host_log_watch(const char *text)
+{
+	if (text == NULL) {
+		host()->watch[0] = '\0';
+	} else {
+		strlcpy(host()->watch, text, LOG_WATCH);
+	}
+	host()->hits = 0;
+}
+
+int host_log_hits()
+{
+	return host()->hits;
+}
+
+int64_t host_clock()
+{
+	return host()->clock;
+}
+
+void host_clock_set(int64_t us)
+{
+	host()->clock = us;
+}
+
+void host_clock_advance(int64_t us)
+{
+	host()->clock += us;
+}
+
+int64_t host_uptime()
+{
+	return host()->clock - host()->boot;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+	host_clock_advance((int64_t)ticks * 1000000 / configTICK_RATE_HZ);
+}
+
+int64_t esp_timer_get_time()
+{
+	return host_uptime();
+}
+
+uint64_t host_timer_wakeup()
+{
+	return host()->timer;
+}
+
+void host_nvs_erase()
+{
+	memset(host()->nvs, 0, sizeof(host()->nvs));
+}
+
+/*
+ * The firmware reads the simulated clock through the libc calls.
+ */
+time_t time(time_t *t)
+{
+	time_t now = host_clock() / 1000000;
+
+	if (t != NULL) {
+		*t = now;
+	}
+
+	return now;
+}
+
+int gettimeofday(struct timeval *tv, void *tz)
+{
+	tv->tv_sec = host_clock() / 1000000;
+	tv->tv_usec = host_clock() % 1000000;
+
+	return 0;
+}
+
+esp_reset_reason_t esp_reset_reason()
+{
+	return host()->reason;
+}
+
+uint32_t esp_random()
+{
+	return (uint32_t)rand() << 16 ^ rand();
+}
+
+uint32_t esp_get_free_heap_size()
+{
+	return HOST_FREE_HEAP;
+}
+
+const char *esp_err_to_name(esp_err_t err)
+{
+	return err == ESP_OK ? "ESP_OK" : "ESP_ERR";
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us)
+{
+	host()->timer = time_in_us;
+
+	return ESP_OK;
+}
+
+/*
+ * The handles are the indexes of the open namespaces.
+ */
+#define NVS_HANDLES 4
+
+static char s_nvs_open[NVS_HANDLES][NVS_NAME];
+
+esp_err_t nvs_flash_init()
+{
+	return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase()
+{
+	host_nvs_erase();
+
+	return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode,
+    nvs_handle_t *out_handle)
+{
+	for (int i = 0; i < NVS_HANDLES; i++) {
+		if (s_nvs_open[i][0] == '\0') {
+			strlcpy(s_nvs_open[i], name, NVS_NAME);
+			*out_handle = i;
+			return ESP_OK;
+		}
+	}
+
+	return ESP_ERR_NO_MEM;
+}
+
+static host_nvs_t *nvs_find(nvs_handle_t handle, const char *key)
+{
+	for (int i = 0; i < NVS_ENTRIES; i++) {
+		host_nvs_t *e = &host()->nvs[i];
+
+		if (e->len > 0 && strcmp(e->ns, s_nvs_open[handle]) == 0 &&
+		    strcmp(e->key, key) == 0) {
+			return e;
+		}
+	}
+
+	return NULL;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value,
+    size_t *length)
+{
+	host_nvs_t *e = nvs_find(handle, key);
+
+	host_boundary("nvs");
+
+	if (e == NULL) {
+		return ESP_ERR_NVS_NOT_FOUND;
+	}
+	if (out_value != NULL) {
+		if (*length < e->len) {
+			return ESP_ERR_NVS_INVALID_LENGTH;
+		}
+		memcpy(out_value, e->data, e->len);
+	}
+	*length = e->len;
+
+	return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key,
+    const void *value, size_t length)
+{
+	host_nvs_t *e = nvs_find(handle, key);
+
+	host_boundary("nvs");
+
+	if (length == 0 || length > NVS_BLOB) {
+		return ESP_ERR_NVS_INVALID_LENGTH;
+	}
+
+	for (int i = 0; e == NULL && i < NVS_ENTRIES; i++) {
+		if (host()->nvs[i].len == 0) {
+			e = &host()->nvs[i];
+		}
+	}
+	if (e == NULL) {
+		return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+	}
+
+	/* the flash entry is replaced as a whole, like the NVS pages do */
+	strlcpy(e->ns, s_nvs_open[handle], NVS_NAME);
+	strlcpy(e->key, key, NVS_NAME);
+	memcpy(e->data, value, length);
+	e->len = length;
+
+	return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+	host_nvs_t *e = nvs_find(handle, key);
+
+	if (e == NULL) {
+		return ESP_ERR_NVS_NOT_FOUND;
+	}
+	e->len = 0;
+
+	return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+	return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+	s_nvs_open[handle][0] = '\0';
+}
+
+struct host_sem {
+	int given;
+};
+
+SemaphoreHandle_t xSemaphoreCreateBinary()
+{
+	return calloc(1, sizeof(struct host_sem));
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+	SemaphoreHandle_t sem = xSemaphoreCreateBinary();
+
+	sem->given = 1;
+
+	return sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+	CHECK(sem->given >= 0);
+	/* nothing else runs, a missing give never comes */
+	if (!sem->given) {
+		vTaskDelay(ticks);
+		return pdFALSE;
+	}
+	sem->given = 0;
+
+	return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+	CHECK(sem->given >= 0);
+	if (sem->given) {
+		return pdFALSE;
+	}
+	sem->given = 1;
+
+	return pdTRUE;
+}
+
+/*
+ * Kept marked deleted, a later use fails the test instead of reading the
+ * freed memory as the device would.
+ */
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+	sem->given = -1;
+}
+
+host_ble_t *host_ble()
+{
+	return &host()->ble;
+}
+
+esp_err_t esp_bt_controller_mem_release(esp_bt_mode_t mode)
+{
+	return ESP_OK;
+}
+
+esp_err_t esp_bt_controller_init(esp_bt_controller_config_t *cfg)
+{
+	host_ble()->start = -1;
+	host_ble()->stop = -1;
+
+	return ESP_OK;
+}
+
+esp_err_t esp_bt_controller_enable(esp_bt_mode_t mode)
+{
+	return mode == ESP_BT_MODE_BLE ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_bluedroid_init()
+{
+	return ESP_OK;
+}
+
+esp_err_t esp_bluedroid_enable()
+{
+	return ESP_OK;
+}
+
+/*
+ * The controller completes every request before returning, the events
+ * come from the Bluedroid task on the device.
+ */
+static esp_gap_ble_cb_t s_gap_cb;
+
+esp_err_t esp_ble_gap_register_callback(esp_gap_ble_cb_t callback)
+{
+	s_gap_cb = callback;
+
+	return ESP_OK;
+}
+
+static void gap_event(esp_gap_ble_cb_event_t event, esp_bt_status_t status)
+{
+	esp_ble_gap_cb_param_t param = { .adv_start_cmpl.status = status };
+
+	if (s_gap_cb != NULL) {
+		s_gap_cb(event, &param);
+	}
+}
+
+esp_err_t esp_ble_gap_config_adv_data_raw(uint8_t *raw_data,
+    uint32_t raw_data_len)
+{
+	host_ble_t *ble = host_ble();
+
+	if (raw_data_len > sizeof(ble->data)) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	memcpy(ble->data, raw_data, raw_data_len);
+	ble->len = raw_data_len;
+	gap_event(ESP_GAP_BLE_ADV_DATA_RAW_SET_COMPLETE_EVT,
+	    ESP_BT_STATUS_SUCCESS);
+
+	return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_start_advertising(esp_ble_adv_params_t *adv_params)
+{
+	host_ble_t *ble = host_ble();
+
+	ble->interval_min = adv_params->adv_int_min;
+	ble->interval_max = adv_params->adv_int_max;
+	ble->type = adv_params->adv_type;
+	if (!ble->fail) {
+		ble->start = host_uptime();
+	}
+	if (ble->late) {
+		ble->held = 1;
+		return ESP_OK;
+	}
+	gap_event(ESP_GAP_BLE_ADV_START_COMPLETE_EVT,
+	    ble->fail ? ESP_BT_STATUS_FAIL : ESP_BT_STATUS_SUCCESS);
+
+	return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_stop_advertising()
+{
+	host_ble()->stop = host_uptime();
+	gap_event(ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT, ESP_BT_STATUS_SUCCESS);
+
+	return ESP_OK;
+}
+
+void host_ble_late()
+{
+	host_ble_t *ble = host_ble();
+
+	if (ble->held) {
+		ble->held = 0;
+		gap_event(ESP_GAP_BLE_ADV_START_COMPLETE_EVT,
+		    ESP_BT_STATUS_SUCCESS);
+	}
+}
+
+/*
+ * One server with a few handlers, the requests run in the caller.
+ */
+#define HTTPD_URIS 4
+
+static int s_httpd_started;
+static httpd_uri_t s_httpd_uri[HTTPD_URIS];
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config)
+{
+	if (s_httpd_started) {
+		return ESP_ERR_INVALID_STATE;
+	}
+	s_httpd_started = 1;
+	*handle = &s_httpd_started;
+
+	return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle)
+{
+	s_httpd_started = 0;
+	memset(s_httpd_uri, 0, sizeof(s_httpd_uri));
+
+	return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle,
+    const httpd_uri_t *uri_handler)
+{
+	for (int i = 0; i < HTTPD_URIS; i++) {
+		if (s_httpd_uri[i].uri == NULL) {
+			s_httpd_uri[i] = *uri_handler;
+			return ESP_OK;
+		}
+	}
+
+	return ESP_ERR_NO_MEM;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type)
+{
+	r->type = type;
+
+	return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+	if (buf_len < 0) {
+		buf_len = strlen(buf);
+	}
+	if (buf_len > r->size) {
+		return ESP_FAIL;
+	}
+	memcpy(r->buf, buf, buf_len);
+	r->len = buf_len;
+
+	return ESP_OK;
+}
+
+int host_httpd_get(const char *uri, char *buf, size_t size)
+{
+	for (int i = 0; s_httpd_started && i < HTTPD_URIS; i++) {
+		httpd_req_t req = {
+			.uri = uri,
+			.user_ctx = s_httpd_uri[i].user_ctx,
+			.buf = buf,
+			.size = size,
+			.len = -1
+		};
+
+		if (s_httpd_uri[i].uri != NULL &&
+		    s_httpd_uri[i].method == HTTP_GET &&
+		    strcmp(s_httpd_uri[i].uri, uri) == 0) {
+			return s_httpd_uri[i].handler(&req) == ESP_OK ?
+			    req.len : -1;
+		}
+	}
+
+	return -1;
+}
+
+uint32_t esp_log_timestamp()
+{
+	return host_uptime() / 1000;
+}
+
+void host_log(char level, const char *tag, const char *fmt, ...)
+{
+	char line[256];
+	va_list ap;
+
+	if (host()->watch[0] != '\0') {
+		va_start(ap, fmt);
+		vsnprintf(line, sizeof(line), fmt, ap);
+		va_end(ap);
+		if (strstr(line, host()->watch) != NULL) {
+			host()->hits++;
+		}
+	}
+
+	if (getenv("HOST_LOG") == NULL) {
+		return;
+	}
+
+	va_start(ap, fmt);
+	printf("%c %s: ", level, tag);
+	vprintf(fmt, ap);
+	printf("\n");
+	va_end(ap);
+}
+
+/*
+ * The ROM variant, equal to the zlib CRC32 with crc 0. Table driven like
+ * the ROM one, so the benchmarks see its cost.
+ */
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+	static uint32_t table[256];
+
+	if (table[1] == 0) {
+		for (uint32_t n = 0; n < 256; n++) {
+			uint32_t c = n;
+
+			for (int i = 0; i < 8; i++) {
+				c = (c >> 1) ^ (0xedb88320 & -(c & 1));
+			}
+			table[n] = c;
+		}
+	}
+
+	crc = ~crc;
+	while (len--) {
+		crc = table[(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+	}
+
+	return ~crc;
+}
+
+size_t strlcpy(char *dst, const char *src, size_t size)
+{
+	size_t len = strlen(src);
+
+	if (size > 0) {
+		size_t n = len < size - 1 ? len : size - 1;
+
+		memcpy(dst, src, n);
+		dst[n] = '\0';
+	}
+
+	return len;
+}
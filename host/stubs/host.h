@@ -0,0 +1,180 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host emulation of the device: the RTC memory kept over the reboots, the
+ * clock and the test checks.
+ */
+
+#ifndef HOST_H
+#define HOST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "esp_system.h"
+
+/* exit status of a boot cut by host_cut() */
+#define HOST_CUT 77
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, \
+		    __LINE__, #cond); \
+		exit(1); \
+	} \
+} while (0)
+
+/*
+ * Memory shared by the test and all the boots, allocate it before the
+ * first boot.
+ */
+void *host_shared(size_t size);
+
+/*
+ * The emulated RTC memory as the last boot left it.
+ */
+uint8_t *host_rtc(size_t *size);
+
+/*
+ * Remove the power, the RTC memory is lost.
+ */
+void host_power_off(void);
+
+/*
+ * Run fn as one boot of the device in a child process, every static of the
+ * firmware starts from zero and the RTC memory from where the previous
+ * boot left it. Returns the exit status of fn, HOST_CUT when the power was
+ * cut or 128 + signal when it crashed.
+ */
+int host_boot(esp_reset_reason_t reason, int (*fn)(void *), void *arg);
+
+/*
+ * Cut the power in the middle of the boot, keeping the RTC memory as
+ * written so far.
+ */
+void host_cut(void) __attribute__((noreturn));
+
+/*
+ * A write boundary of the firmware, the power can go between any two. The
+ * RTC arena commit steps are "rtc", the NVS writes "nvs", the tests add
+ * their own. The boundary host_cut_at() armed cuts the boot.
+ */
+void host_boundary(const char *kind);
+
+/*
+ * Cut the next boot at its n-th boundary (from 1), 0 runs it whole.
+ */
+void host_cut_at(int n);
+
+/*
+ * The boundaries the last boot passed and the kind of the i-th (from 1).
+ */
+int host_boundaries(void);
+const char *host_boundary_kind(int i);
+
+/*
+ * Count the logs of the boots containing text, NULL stops counting.
+ */
+void host_log_watch(const char *text);
+int host_log_hits(void);
+
+/*
+ * Simulated unix time (us), time() and gettimeofday() follow it.
+ */
+int64_t host_clock(void);
+void host_clock_set(int64_t us);
+void host_clock_advance(int64_t us);
+
+/*
+ * Time (us) from the start of the current boot.
+ */
+int64_t host_uptime(void);
+
+/*
+ * The timer wake up the last boot armed (us).
+ */
+uint64_t host_timer_wakeup(void);
+
+/*
+ * Erase the emulated NVS flash.
+ */
+void host_nvs_erase(void);
+
+/*
+ * The emulated BLE controller: set fail before the boot to refuse the
+ * advertising start, late to hold its completion back until
+ * host_ble_late(). The boot records the advertising it did.
+ */
+typedef struct {
+	int fail;
+	int late;
+	int held;			/* a start completion held back */
+	uint8_t data[31];
+	int len;
+	uint16_t interval_min;		/* 0.625ms units */
+	uint16_t interval_max;
+	int type;
+	int64_t start;			/* uptime (us), -1 not started */
+	int64_t stop;
+} host_ble_t;
+
+host_ble_t *host_ble(void);
+void host_ble_late(void);
+
+/*
+ * The emulated BMP280 on the I2C bus: the calibration registers 0x88..0x9f
+ * and the raw readings of a forced measurement.
+ */
+typedef struct {
+	uint16_t dig_t1;
+	int16_t dig_t2, dig_t3;
+	uint16_t dig_p1;
+	int16_t dig_p2, dig_p3, dig_p4, dig_p5, dig_p6, dig_p7, dig_p8, dig_p9;
+	int32_t adc_t, adc_p;
+} host_bmp280_t;
+
+/*
+ * Attach the sensor at addr for the current boot, NULL leaves the bus
+ * without an answer.
+ */
+void host_bmp280(uint8_t addr, const host_bmp280_t *sensor);
+
+/*
+ * GET the uri of the started HTTP server into buf, returns the length of
+ * the response or -1 without a server, a handler or the space.
+ */
+int host_httpd_get(const char *uri, char *buf, size_t size);
+
+/*
+ * The free heap the firmware sees.
+ */
+#define HOST_FREE_HEAP 123456
+
+#endif /* HOST_H */
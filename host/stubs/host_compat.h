@@ -0,0 +1,17 @@
+/*
+ * Included before every source of the host build, the BSD and newlib
+ * functions glibc lacks and the power cut points of the firmware.
+ */
+
+#ifndef HOST_COMPAT_H
+#define HOST_COMPAT_H
+
+#include <stddef.h>
+
+size_t strlcpy(char *dst, const char *src, size_t size);
+
+/* the steps of the RTC arena commit, see host_boundary() */
+void host_boundary(const char *kind);
+#define RTC_ARENA_BARRIER() host_boundary("rtc")
+
+#endif /* HOST_COMPAT_H */
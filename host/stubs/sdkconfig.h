@@ -0,0 +1,97 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host build configuration, the Kconfig.projbuild defaults.
+ */
+
+#ifndef SDKCONFIG_H
+#define SDKCONFIG_H
+
+#define CONFIG_WIFI_SSID "myssid"
+#define CONFIG_WIFI_PASSWORD "mypass"
+#ifndef CONFIG_MAXIMUM_RETRY
+#define CONFIG_MAXIMUM_RETRY 5
+#endif
+#define CONFIG_WIFI_CONNECT_TIMEOUT 15000
+#define CONFIG_WIFI_RETRY_BASE_MS 250
+#define CONFIG_WIFI_RETRY_MAX_MS 4000
+#define CONFIG_BLE_ADV_DURATION 300
+#define CONFIG_BLE_COMPANY_ID 0xffff
+#define CONFIG_INFLUX_IP "192.168.1.1"
+#define CONFIG_INFLUX_PORT "8086"
+#define CONFIG_INFLUX_DB "test"
+#define CONFIG_INFLUX_MEAS "baro"
+#define CONFIG_INFLUX_SITE "mysite"
+#define CONFIG_INFLUX_PLACE "myplace"
+#define CONFIG_SNTP_SERVER "pool.ntp.org"
+#define CONFIG_SNTP_BACKOFF_MAX 21600
+#define CONFIG_SAMPLE_BUF_SIZE 32
+#define CONFIG_BATCH_SIZE 1
+#define CONFIG_UPLOAD_CHUNK 8
+#define CONFIG_UPLOAD_BUDGET_MS 5000
+#define CONFIG_FLUSH_STALE 3600
+#define CONFIG_LINK_SAMPLE_COST_MS 2000
+#define CONFIG_LINK_RETRY_MS 1000
+#define CONFIG_LINK_RSSI_WEAK -80
+#define CONFIG_COMPRESS_TEMP_ERR 5
+#define CONFIG_COMPRESS_PRES_ERR 5
+#ifndef CONFIG_TEMP_CADENCE
+#define CONFIG_TEMP_CADENCE 0
+#endif
+#define CONFIG_TEMP_PRECISION 2
+#ifndef CONFIG_TEMP_THRESHOLD
+#define CONFIG_TEMP_THRESHOLD 0
+#endif
+#ifndef CONFIG_PRES_CADENCE
+#define CONFIG_PRES_CADENCE 0
+#endif
+#ifndef CONFIG_PRES_PRECISION
+#define CONFIG_PRES_PRECISION 2
+#endif
+#ifndef CONFIG_PRES_THRESHOLD
+#define CONFIG_PRES_THRESHOLD 0
+#endif
+#define CONFIG_SAFE_TIMER 3600
+#define CONFIG_BMP_OSRST 1
+#define CONFIG_BMP_OSRSP 1
+#define CONFIG_BMP_FILTER 0
+#define CONFIG_BMP_TDIFF 20
+#define CONFIG_BMP_PDIFF 10
+#define CONFIG_BMP_PERIOD 5
+#define CONFIG_SLEEP_ISOLATE_GPIO 0x1000
+#define CONFIG_SLEEP_PD_RTC_FAST 1
+#define CONFIG_SLEEP_PD_XTAL 1
+#define CONFIG_RTC_ARENA_SIZE 2048
+#define CONFIG_RTC_ARENA_UNDO 1028
+#define CONFIG_MODE_COLD_WAKE_MJ 300
+#define CONFIG_MODE_CONNECTED_MW 10
+#define CONFIG_MODE_HYSTERESIS 50
+#define CONFIG_METRICS_PORT 9100
+
+#endif /* SDKCONFIG_H */
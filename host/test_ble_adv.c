@@ -0,0 +1,179 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_gap_ble_api.h"
+
+#include "ble_adv.h"
+#include "host.h"
+#include "sdkconfig.h"
+
+
+/* flags and the manufacturer specific data AD structures */
+#define ADV_LEN (3 + 2 + BLE_ADV_PAYLOAD_LEN)
+#define PAYLOAD 5
+
+static int send(void *arg)
+{
+	const float *value = arg;
+	sample_t sample = {
+		.field[SAMPLE_TEMP].mean = value[0],
+		.field[SAMPLE_PRES].mean = value[1]
+	};
+
+	return ble_adv_send(&sample) == ESP_OK ? 0 : 1;
+}
+
+/*
+ * Non connectable advertising at 100ms at least, the spec minimum for it,
+ * for the configured time.
+ */
+static void test_advertising()
+{
+	float value[2] = { 21.5, 1013.25 };
+	host_ble_t *ble = host_ble();
+
+	host_power_off();
+	CHECK(host_boot(ESP_RST_DEEPSLEEP, send, value) == 0);
+
+	CHECK(ble->type == ADV_TYPE_NONCONN_IND);
+	CHECK(ble->interval_min >= 160);
+	CHECK(ble->interval_max >= ble->interval_min);
+	CHECK(ble->start >= 0);
+	CHECK(ble->stop - ble->start == CONFIG_BLE_ADV_DURATION * 1000);
+
+	CHECK(ble->len == ADV_LEN);
+	CHECK(ble->data[1] == ESP_BLE_AD_TYPE_FLAG);
+	CHECK(ble->data[3] == 1 + BLE_ADV_PAYLOAD_LEN);
+	CHECK(ble->data[4] == ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE);
+	CHECK((ble->data[PAYLOAD] | ble->data[PAYLOAD + 1] << 8) ==
+	    CONFIG_BLE_COMPANY_ID);
+	CHECK(ble->data[PAYLOAD + 2] == BLE_ADV_VERSION);
+}
+
+/*
+ * The controller refusing the start fails the send, the caller keeps the
+ * sample.
+ */
+static void test_start_fail()
+{
+	float value[2] = { 21.5, 1013.25 };
+	host_ble_t *ble = host_ble();
+
+	ble->fail = 1;
+	CHECK(host_boot(ESP_RST_DEEPSLEEP, send, value) == 1);
+	CHECK(ble->start < 0);
+	ble->fail = 0;
+}
+
+/*
+ * A start completing after the timeout fails the send and stops the
+ * advertising. The late completion gives a semaphore still alive, the next
+ * send does not take it for its own.
+ */
+static int send_late(void *arg)
+{
+	host_ble_t *ble = host_ble();
+
+	ble->late = 1;
+	CHECK(send(arg) == 1);
+	CHECK(ble->start >= 0 && ble->stop >= ble->start);
+	host_ble_late();
+
+	CHECK(send(arg) == 1);
+	ble->late = 0;
+	host_ble_late();
+
+	return send(arg);
+}
+
+static void test_late_start()
+{
+	float value[2] = { 21.5, 1013.25 };
+
+	CHECK(host_boot(ESP_RST_DEEPSLEEP, send_late, value) == 0);
+}
+
+/*
+ * The sequence counts the advertised samples over the deep sleeps.
+ */
+static void test_seq()
+{
+	float value[2] = { 21.5, 1013.25 };
+	host_ble_t *ble = host_ble();
+	int seq;
+
+	CHECK(host_boot(ESP_RST_DEEPSLEEP, send, value) == 0);
+	seq = ble->data[PAYLOAD + 3] | ble->data[PAYLOAD + 4] << 8;
+	CHECK(host_boot(ESP_RST_DEEPSLEEP, send, value) == 0);
+	CHECK((ble->data[PAYLOAD + 3] | ble->data[PAYLOAD + 4] << 8) ==
+	    seq + 1);
+}
+
+/*
+ * Print the advertisement data with the advertised values for the round
+ * trip through tools/ble_receiver.py, out of range values are clamped.
+ */
+static void frames()
+{
+	static const float values[][2] = {
+		{ 21.5, 1013.25 },
+		{ -12.34, 950.01 },
+		{ 0, 0 },
+		{ 327.67, 167772.15 },
+		{ -400, -5 },
+		{ 400, 200000 },
+	};
+	host_ble_t *ble = host_ble();
+
+	host_power_off();
+	for (int i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+		CHECK(host_boot(ESP_RST_DEEPSLEEP, send,
+		    (void *)values[i]) == 0);
+		for (int j = 0; j < ble->len; j++) {
+			printf("%02x", ble->data[j]);
+		}
+		printf(" %.2f %.2f\n", values[i][0], values[i][1]);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1 && strcmp(argv[1], "frames") == 0) {
+		frames();
+		return 0;
+	}
+
+	test_advertising();
+	test_start_fail();
+	test_late_start();
+	test_seq();
+
+	return 0;
+}
@@ -0,0 +1,44 @@
+#!/usr/bin/env python3
+#
+# Round trip of the BLE advertisement: the firmware encodes the samples in
+# the host build (test_ble_adv frames), tools/ble_receiver.py decodes them.
+#
+#   test_ble_receiver.py path/to/test_ble_adv
+#
+
+import os
+import subprocess
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                "..", "tools"))
+import ble_receiver
+
+
+def clamp(v, low, high):
+    return min(max(round(v * 100), low), high) / 100
+
+
+def main():
+    out = subprocess.run([sys.argv[1], "frames"], check=True,
+                         stdout=subprocess.PIPE, universal_newlines=True)
+    frames = [line.split() for line in out.stdout.splitlines()]
+    assert len(frames) > 0
+
+    for seq, (adv, temp, pres) in enumerate(frames):
+        data = ble_receiver.manufacturer_data(bytes.fromhex(adv))
+        sample = ble_receiver.decode(data)
+        assert sample is not None, adv
+        assert sample[0] == seq, (adv, sample)
+        assert sample[1] == clamp(float(temp), -32768, 32767), (adv, sample)
+        assert sample[2] == clamp(float(pres), 0, 0xffffff), (adv, sample)
+        assert sample[3] == 0, (adv, sample)
+
+        # a foreign company or version is not ours
+        assert ble_receiver.decode(data, 0x0059) is None
+        assert ble_receiver.decode(data[:2] + b"\x02" + data[3:]) is None
+        assert ble_receiver.decode(data[:-1]) is None
+
+
+if __name__ == "__main__":
+    main()
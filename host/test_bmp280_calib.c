@@ -0,0 +1,200 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <math.h>
+
+#include "bmp280_calib.h"
+#include "host.h"
+#include "sdkconfig.h"
+
+
+/* the ULP compares the 16 most significant bits of the 20 bit readings */
+#define RAW_STEP 16
+
+/*
+ * The calibration register dumps (0x88..0x9f) and the readings. Only the
+ * datasheet example comes from a sensor, the other two are synthetic:
+ * coefficients made up within the spread of the datasheet example to
+ * cover other slopes, not read from a part.
+ */
+typedef struct {
+	const char *name;
+	host_bmp280_t bmp;
+} dump_t;
+
+static const dump_t s_dumps[] = {
+	/* the datasheet example, 25.08C and 100653.27Pa */
+	{ "datasheet", { 27504, 26435, -1000, 36477, -10685, 3024, 2855, 140,
+	    -7, 15500, -14600, 6000, 519888, 415148 } },
+	/* synthetic, room temperature at sea level */
+	{ "synthetic room", { 28009, 25654, 50, 39145, -10750, 3024, 5667,
+	    -120, -7, 15500, -14600, 6000, 530000, 330000 } },
+	/* synthetic, cold at high altitude */
+	{ "synthetic cold", { 27256, 26531, 50, 37650, -10560, 3024, 4013, 53,
+	    -7, 9900, -10230, 4285, 460000, 520000 } },
+};
+
+
+/*
+ * The datasheet 32-bit integer compensation, 0.01C.
+ */
+static int32_t ref_t(const host_bmp280_t *d, int32_t adc_t, int32_t *t_fine)
+{
+	int32_t var1, var2;
+
+	var1 = ((((adc_t >> 3) - ((int32_t)d->dig_t1 << 1))) *
+	    ((int32_t)d->dig_t2)) >> 11;
+	var2 = (((((adc_t >> 4) - ((int32_t)d->dig_t1)) *
+	    ((adc_t >> 4) - ((int32_t)d->dig_t1))) >> 12) *
+	    ((int32_t)d->dig_t3)) >> 14;
+	*t_fine = var1 + var2;
+
+	return (*t_fine * 5 + 128) >> 8;
+}
+
+/*
+ * The datasheet 64-bit integer compensation, Pa in Q24.8.
+ */
+static int64_t ref_p(const host_bmp280_t *d, int32_t adc_p, int32_t t_fine)
+{
+	int64_t var1, var2, p;
+
+	var1 = (int64_t)t_fine - 128000;
+	var2 = var1 * var1 * d->dig_p6;
+	var2 = var2 + ((var1 * d->dig_p5) << 17);
+	var2 = var2 + ((int64_t)d->dig_p4 << 35);
+	var1 = ((var1 * var1 * d->dig_p3) >> 8) + ((var1 * d->dig_p2) << 12);
+	var1 = ((((int64_t)1) << 47) + var1) * d->dig_p1 >> 33;
+	if (var1 == 0) {
+		return 0;
+	}
+	p = 1048576 - adc_p;
+	p = (((p << 31) - var2) * 3125) / var1;
+	var1 = ((int64_t)d->dig_p9 * (p >> 13) * (p >> 13)) >> 25;
+	var2 = ((int64_t)d->dig_p8 * p) >> 19;
+
+	return ((p + var1 + var2) >> 8) + ((int64_t)d->dig_p7 << 4);
+}
+
+/*
+ * The reference change of one compared step, averaged over a wider span
+ * than the integer resolution.
+ */
+static double ref_t_step(const host_bmp280_t *d)
+{
+	int32_t t_fine;
+	int span = 256;
+
+	return (double)(ref_t(d, d->adc_t + span * RAW_STEP, &t_fine) -
+	    ref_t(d, d->adc_t, &t_fine)) / span;
+}
+
+static double ref_p_step(const host_bmp280_t *d)
+{
+	int32_t t_fine;
+	int span = 256;
+
+	ref_t(d, d->adc_t, &t_fine);
+
+	return (double)(ref_p(d, d->adc_p + span * RAW_STEP, t_fine) -
+	    ref_p(d, d->adc_p, t_fine)) / 256 / span;
+}
+
+/*
+ * The raw threshold is the difference in the compared steps, rounded.
+ */
+static void check_raw(uint32_t raw, double diff, double step)
+{
+	double want = fabs(diff / step);
+
+	if (want < 1) {
+		CHECK(raw == 1);
+		return;
+	}
+	CHECK(fabs(raw - want) <= 0.5 + want * 0.01);
+}
+
+static int calibrate(void *arg)
+{
+	const dump_t *d = arg;
+
+	host_bmp280(CONFIG_BMP_ADDR, d != NULL ? &d->bmp : NULL);
+
+	return bmp280_calib_read() == ESP_OK ? 0 : 1;
+}
+
+static int check_dump(void *arg)
+{
+	const host_bmp280_t *d = &((const dump_t *)arg)->bmp;
+	uint32_t diffs[] = { 1, 5, 10, 39, 100, 1000 };
+
+	for (int i = 0; i < sizeof(diffs) / sizeof(diffs[0]); i++) {
+		check_raw(bmp280_calib_t_diff(diffs[i]), diffs[i],
+		    ref_t_step(d));
+		check_raw(bmp280_calib_p_diff(diffs[i]), diffs[i],
+		    ref_p_step(d));
+	}
+
+	return 0;
+}
+
+static int check_nominal(void *arg)
+{
+	/* the BMP_TDIFF and BMP_PDIFF defaults, 20 ~ 0.1C and 10 ~ 39Pa */
+	CHECK(bmp280_calib_t_diff(10) == 20);
+	CHECK(bmp280_calib_p_diff(39) == 10);
+	CHECK(bmp280_calib_p_diff(390) == 100);
+
+	return 0;
+}
+
+int main()
+{
+	const host_bmp280_t *d = &s_dumps[0].bmp;
+	int32_t t_fine;
+
+	/* the reference itself, the datasheet example */
+	CHECK(ref_t(d, d->adc_t, &t_fine) == 2508);
+	CHECK(ref_p(d, d->adc_p, t_fine) / 256 == 100653);
+
+	for (int i = 0; i < sizeof(s_dumps) / sizeof(s_dumps[0]); i++) {
+		host_power_off();
+		CHECK(host_boot(ESP_RST_POWERON, calibrate,
+		    (void *)&s_dumps[i]) == 0);
+		/* the calibration is kept over the deep sleep */
+		CHECK(host_boot(ESP_RST_DEEPSLEEP, check_dump,
+		    (void *)&s_dumps[i]) == 0);
+	}
+
+	/* no sensor on the bus, the nominal conversion */
+	host_power_off();
+	CHECK(host_boot(ESP_RST_POWERON, calibrate, NULL) == 1);
+	CHECK(host_boot(ESP_RST_DEEPSLEEP, check_nominal, NULL) == 0);
+
+	return 0;
+}
@@ -0,0 +1,147 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "compress.h"
+#include "host.h"
+
+
+#define N 256
+#define RUNS 2000
+
+typedef enum {
+	SERIES_WALK,		/* random walk */
+	SERIES_STEPS,		/* flat with jumps */
+	SERIES_RAMP,		/* slow linear drift with noise */
+	SERIES_SAME_TIME,	/* repeated timestamps */
+	SERIES_MAX
+} series_t;
+
+
+static float frand(float max)
+{
+	return (float)rand() / RAND_MAX * max;
+}
+
+static void generate(series_t type, uint32_t *t, float *v, int n)
+{
+	uint32_t time = 1700000000;
+	float value = 1000;
+
+	for (int i = 0; i < n; i++) {
+		time += 1 + rand() % 600;
+		switch (type) {
+			case SERIES_WALK:
+				value += frand(2) - 1;
+				break;
+			case SERIES_STEPS:
+				if (rand() % 16 == 0) {
+					value += frand(20) - 10;
+				}
+				break;
+			case SERIES_RAMP:
+				value = 1000 + i * 0.05f + frand(0.02f);
+				break;
+			case SERIES_SAME_TIME:
+				if (rand() % 4 == 0) {
+					time -= time > 1700000000 ? 1 : 0;
+				}
+				value += frand(0.4f) - 0.2f;
+				break;
+			default:
+				break;
+		}
+		t[i] = time;
+		v[i] = value;
+	}
+}
+
+/*
+ * Every dropped point lies within err of the line between the kept ones
+ * around it, the first and the last point are kept.
+ */
+static void check_bound(const uint32_t *t, const float *v, int n, float err,
+    const bool *keep, int kept)
+{
+	int a = 0;
+	int count = 0;
+
+	for (int i = 0; i < n; i++) {
+		count += keep[i];
+	}
+	CHECK(count == kept);
+	CHECK(n == 0 || (keep[0] && keep[n - 1]));
+
+	for (int b = 1; b < n; b++) {
+		if (!keep[b]) {
+			continue;
+		}
+		for (int i = a + 1; i < b; i++) {
+			double line = v[a] + (double)(v[b] - v[a]) *
+			    ((double)t[i] - t[a]) / ((double)t[b] - t[a]);
+
+			/* the float rounding of the slopes */
+			CHECK(fabs(line - v[i]) <= err + 1e-3);
+		}
+		a = b;
+	}
+}
+
+int main()
+{
+	uint32_t t[N];
+	float v[N];
+	bool keep[N];
+	float errs[] = { 0, 0.01f, 0.05f, 0.5f, 5 };
+	int n, kept;
+
+	srand(1);
+
+	for (int run = 0; run < RUNS; run++) {
+		series_t type = run % SERIES_MAX;
+		float err = errs[run % (sizeof(errs) / sizeof(errs[0]))];
+
+		n = rand() % (N + 1);
+		generate(type, t, v, n);
+		kept = compress_sdt(t, v, n, err, keep);
+		check_bound(t, v, n, err, keep, kept);
+	}
+
+	/* a straight line is two points */
+	for (int i = 0; i < N; i++) {
+		t[i] = 1700000000 + i * 60;
+		v[i] = 20 + i * 0.25f;
+	}
+	CHECK(compress_sdt(t, v, N, 0.01f, keep) == 2);
+	CHECK(compress_sdt(t, v, 1, 0.01f, keep) == 1 && keep[0]);
+	CHECK(compress_sdt(t, v, 0, 0.01f, keep) == 0);
+
+	return 0;
+}
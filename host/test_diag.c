@@ -0,0 +1,270 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "driver/uart.h"
+#include "esp_rom_crc.h"
+
+#include "diag.h"
+#include "host.h"
+#include "sample_buf.h"
+#include "sdkconfig.h"
+
+
+#define S 1000000LL
+#define START 1700000000
+
+#define HEADER_SIZE 10
+#define FRAME_SIZE(n) (HEADER_SIZE + SAMPLE_FIELDS * 4 + \
+    (n) * sizeof(sample_t) + 4)
+#define CAPTURE (FRAME_SIZE(CONFIG_SAMPLE_BUF_SIZE) + 64)
+
+/* the emulated port, shared by the test and the boots */
+typedef struct {
+	bool fail;		/* refuse the driver install */
+	bool open;
+	int baud;
+	int tx;
+	size_t len;
+	uint8_t data[CAPTURE];
+} port_t;
+
+static port_t *s_port;
+
+
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size,
+    int tx_buffer_size, int queue_size, QueueHandle_t *uart_queue,
+    int intr_alloc_flags)
+{
+	if (s_port->fail || uart_num != CONFIG_DIAG_UART) {
+		return ESP_FAIL;
+	}
+	s_port->open = true;
+
+	return ESP_OK;
+}
+
+esp_err_t uart_driver_delete(uart_port_t uart_num)
+{
+	s_port->open = false;
+
+	return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t uart_num,
+    const uart_config_t *uart_config)
+{
+	s_port->baud = uart_config->baud_rate;
+
+	return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t uart_num, int tx_io_num, int rx_io_num,
+    int rts_io_num, int cts_io_num)
+{
+	s_port->tx = tx_io_num;
+
+	return ESP_OK;
+}
+
+int uart_write_bytes(uart_port_t uart_num, const void *src, size_t size)
+{
+	CHECK(s_port->open && s_port->len + size <= CAPTURE);
+	memcpy(s_port->data + s_port->len, src, size);
+	s_port->len += size;
+
+	return size;
+}
+
+esp_err_t uart_wait_tx_done(uart_port_t uart_num, TickType_t ticks_to_wait)
+{
+	return ESP_OK;
+}
+
+static float sample_temp(int i)
+{
+	return 20 + i * 0.25;
+}
+
+static float sample_pres(int i)
+{
+	return 1000 + i;
+}
+
+/*
+ * Push the sample i and export the frame with the latest readings.
+ */
+static int export(void *arg)
+{
+	int i = *(int *)arg;
+	float value[SAMPLE_FIELDS] = { sample_temp(i), sample_pres(i) };
+	float latest[SAMPLE_FIELDS] = { 21 + i, 1001 + i };
+
+	sample_buf_push(time(NULL), value, i % 2);
+	diag_export(latest);
+
+	return 0;
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static float getf(const uint8_t *p)
+{
+	uint32_t u = get32(p);
+	float f;
+
+	memcpy(&f, &u, sizeof(f));
+
+	return f;
+}
+
+/*
+ * The frame as diag.h documents it.
+ */
+static void test_frame()
+{
+	const uint8_t *p = s_port->data;
+	int n;
+
+	host_power_off();
+	host_clock_set((int64_t)START * S);
+	for (int i = 0; i < 4; i++) {
+		s_port->len = 0;
+		host_clock_advance(60 * S);
+		CHECK(host_boot(ESP_RST_DEEPSLEEP, export, &i) == 0);
+	}
+
+	n = 4;
+	CHECK(s_port->len == FRAME_SIZE(n));
+	CHECK(!s_port->open && s_port->baud == CONFIG_DIAG_BAUD &&
+	    s_port->tx == CONFIG_DIAG_TX_GPIO);
+	CHECK(p[0] == 0xa5 && p[1] == 0x5a && p[2] == 1 &&
+	    p[3] == SAMPLE_FIELDS);
+	CHECK((p[4] | p[5] << 8) == n);
+	CHECK(get32(p + 6) == START + n * 60);
+	CHECK(getf(p + 10) == 24 && getf(p + 14) == 1004);
+
+	p += HEADER_SIZE + SAMPLE_FIELDS * 4;
+	for (int i = 0; i < n; i++, p += sizeof(sample_t)) {
+		CHECK(get32(p) == START + (i + 1) * 60);
+		CHECK((p[4] | p[5] << 8) == 1 && (p[6] | p[7] << 8) == i % 2);
+		for (int k = 0; k < 3; k++) {
+			CHECK(getf(p + 8 + k * 4) == sample_temp(i));
+			CHECK(getf(p + 20 + k * 4) == sample_pres(i));
+		}
+	}
+
+	CHECK(get32(p) == esp_rom_crc32_le(0, s_port->data + 2,
+	    p - s_port->data - 2));
+}
+
+/*
+ * Without the port the sample is kept, nothing is sent.
+ */
+static void test_no_port()
+{
+	int i = 0;
+
+	host_power_off();
+	s_port->len = 0;
+	s_port->fail = true;
+	CHECK(host_boot(ESP_RST_DEEPSLEEP, export, &i) == 0);
+	CHECK(s_port->len == 0 && !s_port->open);
+	s_port->fail = false;
+}
+
+static void frame_print()
+{
+	for (int j = 0; j < s_port->len; j++) {
+		printf("%02x", s_port->data[j]);
+	}
+}
+
+/*
+ * Print every frame in hex with the time, the latest readings and the
+ * samples as time:count:flags:temp:pres for the round trip through
+ * tools/diag_decode.py.
+ */
+static void frames()
+{
+	host_power_off();
+	host_clock_set((int64_t)START * S);
+	for (int i = 0; i < 6; i++) {
+		s_port->len = 0;
+		host_clock_advance(60 * S);
+		CHECK(host_boot(ESP_RST_DEEPSLEEP, export, &i) == 0);
+		frame_print();
+		printf(" %u %g %g", START + (i + 1) * 60, 21.0 + i,
+		    1001.0 + i);
+		for (int j = 0; j <= i; j++) {
+			printf(" %u:1:%d:%g:%g", START + (j + 1) * 60, j % 2,
+			    sample_temp(j), sample_pres(j));
+		}
+		printf("\n");
+	}
+}
+
+/*
+ * Print a frame every half an hour for a day and a half, the capture
+ * the replay of tools/diag_decode.py turns into an energy trace.
+ */
+static void day()
+{
+	host_power_off();
+	host_clock_set((int64_t)START * S);
+	for (int i = 0; i < 72; i++) {
+		s_port->len = 0;
+		host_clock_advance(1800 * S);
+		CHECK(host_boot(ESP_RST_DEEPSLEEP, export, &i) == 0);
+		frame_print();
+		printf("\n");
+	}
+}
+
+int main(int argc, char **argv)
+{
+	s_port = host_shared(sizeof(*s_port));
+
+	if (argc > 1 && strcmp(argv[1], "frames") == 0) {
+		frames();
+		return 0;
+	}
+	if (argc > 1 && strcmp(argv[1], "day") == 0) {
+		day();
+		return 0;
+	}
+
+	test_frame();
+	test_no_port();
+
+	return 0;
+}
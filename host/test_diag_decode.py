@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+#
+# Round trip of the diagnostic UART frames: the firmware builds them in the
+# host build (test_diag frames), tools/diag_decode.py decodes them out of a
+# capture with the noise of a real UART. The replay of a day of frames is
+# loaded as an energy trace by test_energy.
+#
+#   test_diag_decode.py path/to/test_diag path/to/test_energy
+#
+
+import os
+import subprocess
+import sys
+import tempfile
+
+TOOLS = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..",
+                     "tools")
+sys.path.insert(0, TOOLS)
+import diag_decode
+
+
+def expected(words):
+    now, temp, pres = int(words[0]), float(words[1]), float(words[2])
+    samples = []
+    for word in words[3:]:
+        t, count, flags, st, sp = word.split(":")
+        st, sp = float(st), float(sp)
+        samples.append((int(t), int(count), int(flags),
+                        st, st, st, sp, sp, sp))
+    return now, 2, (temp, pres), samples
+
+
+def main():
+    out = subprocess.run([sys.argv[1], "frames"], check=True,
+                         stdout=subprocess.PIPE, universal_newlines=True)
+    lines = [line.split() for line in out.stdout.splitlines()]
+    assert len(lines) > 0
+
+    frames = [bytes.fromhex(line[0]) for line in lines]
+    want = [expected(line[1:]) for line in lines]
+
+    # each frame alone
+    for frame, w in zip(frames, want):
+        got = list(diag_decode.frames(frame))
+        assert len(got) == 1, frame.hex()
+        now, fields, latest, samples = got[0]
+        assert (now, fields, tuple(latest)) == w[:3], (got, w)
+        assert [tuple(s) for s in samples] == w[3], (samples, w)
+
+    # the boot log around, a corrupted frame, a sync in the noise and a
+    # frame cut by the end of the capture are skipped
+    bad = bytearray(frames[1])
+    bad[12] ^= 0x01
+    capture = (b"boot log\r\n\xa5\x5a\x01" + frames[0] + bytes(bad) +
+               b"\xa5" + b"".join(frames[1:]) + frames[-1][:-3])
+    got = list(diag_decode.frames(capture))
+    assert [g[0] for g in got] == [w[0] for w in want], got
+
+    # the CSV, one ulp row per frame and a row per sample
+    with tempfile.NamedTemporaryFile(suffix=".bin") as f:
+        f.write(capture)
+        f.flush()
+        csv = subprocess.run([sys.executable,
+                              os.path.join(TOOLS, "diag_decode.py"),
+                              f.name], check=True, stdout=subprocess.PIPE,
+                             universal_newlines=True).stdout.splitlines()
+    assert csv[0].startswith("frame_time,kind,time,count,flags,temp,")
+    rows = [row.split(",") for row in csv[1:]]
+    assert len(rows) == sum(1 + len(w[3]) for w in want), csv
+    assert sum(row[1] == "ulp" for row in rows) == len(want)
+
+    # the replay of a day and a half, the latest readings every half an
+    # hour from the first frame, a frame sent twice is dropped
+    out = subprocess.run([sys.argv[1], "day"], check=True,
+                         stdout=subprocess.PIPE, universal_newlines=True)
+    day = [bytes.fromhex(line) for line in out.stdout.splitlines()]
+    with tempfile.TemporaryDirectory() as d:
+        with open(os.path.join(d, "capture.bin"), "wb") as f:
+            f.write(b"boot log\r\n" + b"".join(day[:10]) + day[9] +
+                    b"".join(day[10:]))
+        with open(os.path.join(d, "replay.csv"), "w") as f:
+            subprocess.run([sys.executable,
+                            os.path.join(TOOLS, "diag_decode.py"),
+                            "--replay", os.path.join(d, "capture.bin")],
+                           check=True, stdout=f)
+        with open(os.path.join(d, "replay.csv")) as f:
+            trace = [line.strip() for line in f
+                     if not line.startswith("#")]
+        assert trace == ["%d,%.2f,%.2f" % (i * 1800, 21 + i, 1001 + i)
+                         for i in range(len(day))], trace
+
+        out = subprocess.run([sys.argv[2], d, "trace", "replay"],
+                             check=True, stdout=subprocess.PIPE,
+                             universal_newlines=True).stdout
+    assert out.startswith("replay: "), out
+
+
+if __name__ == "__main__":
+    main()
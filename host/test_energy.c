@@ -0,0 +1,317 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Energy regression of the wake cycle. The traces of energy/ replay a day
+ * through the ULP threshold wakes, the timer wakes and the upload of every
+ * wake. The modelled wakes, radio on time and uploaded bytes per day may
+ * not exceed energy/baseline.txt by more than TOLERANCE.
+ *
+ *   test_energy <energy dir>		check against the baseline
+ *   test_energy <energy dir> update	print a new baseline
+ *   test_energy <dir> trace <name>	the energy of <dir>/<name>.csv, a
+ *					replay of tools/diag_decode.py
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "flush_sched.h"
+#include "host.h"
+#include "sample_buf.h"
+#include "sdkconfig.h"
+#include "wake_cycle.h"
+
+
+#define S 1000000LL
+#define DAY 86400
+
+#define TOLERANCE 0.05
+
+/* the radio model: association with DHCP, one request, the throughput */
+#define CONNECT_MS 1200
+#define REQUEST_MS 80
+#define BYTES_PER_MS 125
+
+/* the ULP thresholds with the nominal conversion of bmp280_calib.c */
+#define ULP_T_DIFF (CONFIG_BMP_TDIFF / 2.0 / 100)
+#define ULP_P_DIFF (CONFIG_BMP_PDIFF * 39 / 10.0 / 100)
+
+#define TRACE_SIZE 1024
+
+static const char *s_traces[] = { "calm", "front", "heating" };
+
+typedef struct {
+	int n;
+	uint32_t t[TRACE_SIZE];
+	float v[TRACE_SIZE][SAMPLE_FIELDS];
+} trace_t;
+
+/* shared by the test and the boots */
+typedef struct {
+	trace_t trace;
+	int64_t start;		/* us, the trace time 0 */
+	float ulp_ref[SAMPLE_FIELDS];
+	int wakes;
+	double radio_ms;
+	long bytes;
+} sim_t;
+
+typedef struct {
+	double wakes;
+	double radio_s;
+	double bytes;
+} energy_t;
+
+static sim_t *s_sim;
+
+
+static void trace_load(const char *dir, const char *name)
+{
+	trace_t *tr = &s_sim->trace;
+	char path[256];
+	char line[128];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/%s.csv", dir, name);
+	f = fopen(path, "r");
+	CHECK(f != NULL);
+
+	tr->n = 0;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (line[0] == '#') {
+			continue;
+		}
+		CHECK(tr->n < TRACE_SIZE);
+		CHECK(sscanf(line, "%u,%f,%f", &tr->t[tr->n],
+		    &tr->v[tr->n][SAMPLE_TEMP],
+		    &tr->v[tr->n][SAMPLE_PRES]) == 3);
+		tr->n++;
+	}
+	fclose(f);
+
+	CHECK(tr->n > 1 && tr->t[tr->n - 1] >= DAY);
+}
+
+/*
+ * The trace linearly interpolated at the simulated clock.
+ */
+static void trace_at(float value[SAMPLE_FIELDS])
+{
+	const trace_t *tr = &s_sim->trace;
+	double t = (double)(host_clock() - s_sim->start) / S;
+	int i = 0;
+
+	while (i + 2 < tr->n && tr->t[i + 1] <= t) {
+		i++;
+	}
+	for (int f = 0; f < SAMPLE_FIELDS; f++) {
+		double k = (t - tr->t[i]) / (tr->t[i + 1] - tr->t[i]);
+
+		value[f] = tr->v[i][f] + k * (tr->v[i + 1][f] - tr->v[i][f]);
+	}
+}
+
+static esp_err_t connect()
+{
+	s_sim->radio_ms += CONNECT_MS;
+	host_clock_advance(CONNECT_MS * 1000);
+	flush_sched_record(true, -60, 0, CONNECT_MS);
+
+	return ESP_OK;
+}
+
+static esp_err_t post(const char *data, size_t len, int n)
+{
+	double ms = REQUEST_MS + (double)len / BYTES_PER_MS;
+
+	s_sim->radio_ms += ms;
+	s_sim->bytes += len;
+	host_clock_advance(ms * 1000);
+
+	return ESP_OK;
+}
+
+/*
+ * One wake of app_main with a healthy link. The ULP compares to the
+ * reading of the wake.
+ */
+static int wake(void *arg)
+{
+	float value[SAMPLE_FIELDS];
+	const wake_cycle_t cycle = {
+		.connect = connect,
+		.post = post,
+		.budget_end = (int64_t)CONFIG_UPLOAD_BUDGET_MS * 1000
+	};
+
+	trace_at(value);
+	wake_cycle_run(value, &cycle);
+
+	memcpy(s_sim->ulp_ref, value, sizeof(value));
+
+	return 0;
+}
+
+static bool ulp_wake()
+{
+	float value[SAMPLE_FIELDS];
+
+	trace_at(value);
+
+	return fabsf(value[SAMPLE_TEMP] - s_sim->ulp_ref[SAMPLE_TEMP]) >=
+	    ULP_T_DIFF ||
+	    fabsf(value[SAMPLE_PRES] - s_sim->ulp_ref[SAMPLE_PRES]) >=
+	    ULP_P_DIFF;
+}
+
+/*
+ * Replay the day, the ULP measures every BMP_PERIOD s and the timer wake
+ * is armed by the last boot.
+ */
+static energy_t replay(const char *dir, const char *name)
+{
+	int64_t end;
+	int64_t next_ulp;
+	int64_t next_timer;
+	bool ulp;
+
+	host_power_off();
+	host_nvs_erase();
+	trace_load(dir, name);
+	s_sim->start = host_clock();
+	s_sim->wakes = 0;
+	s_sim->radio_ms = 0;
+	s_sim->bytes = 0;
+	CHECK(host_boot(ESP_RST_POWERON, wake, NULL) == 0);
+
+	end = s_sim->start + DAY * S;
+	next_ulp = host_clock() + CONFIG_BMP_PERIOD * S;
+	for (;;) {
+		next_timer = host_clock() + host_timer_wakeup();
+		ulp = false;
+		while (!ulp && next_ulp < next_timer && next_ulp < end) {
+			host_clock_set(next_ulp);
+			next_ulp += CONFIG_BMP_PERIOD * S;
+			ulp = ulp_wake();
+		}
+		if (!ulp) {
+			if (next_timer >= end) {
+				break;
+			}
+			host_clock_set(next_timer);
+		}
+
+		s_sim->wakes++;
+		CHECK(host_boot(ESP_RST_DEEPSLEEP, wake, NULL) == 0);
+
+		/* the ULP keeps its period while the CPU is awake */
+		while (next_ulp <= host_clock()) {
+			next_ulp += CONFIG_BMP_PERIOD * S;
+		}
+	}
+
+	return (energy_t){ s_sim->wakes, s_sim->radio_ms / 1000,
+	    s_sim->bytes };
+}
+
+static bool baseline_get(const char *dir, const char *name, energy_t *e)
+{
+	char path[256];
+	char line[128];
+	char trace[32];
+	bool found = false;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/baseline.txt", dir);
+	f = fopen(path, "r");
+	CHECK(f != NULL);
+
+	while (!found && fgets(line, sizeof(line), f) != NULL) {
+		found = line[0] != '#' && sscanf(line, "%31s %lf %lf %lf",
+		    trace, &e->wakes, &e->radio_s, &e->bytes) == 4 &&
+		    strcmp(trace, name) == 0;
+	}
+	fclose(f);
+
+	return found;
+}
+
+static bool check(const char *what, double value, double base)
+{
+	if (value > base * (1 + TOLERANCE)) {
+		printf("  %s %.1f over the baseline %.1f\n", what, value,
+		    base);
+		return false;
+	}
+	if (value < base * (1 - TOLERANCE)) {
+		printf("  %s %.1f under the baseline %.1f, update it\n", what,
+		    value, base);
+	}
+
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	bool update = argc > 2 && strcmp(argv[2], "update") == 0;
+	bool ok = true;
+	energy_t e, base;
+
+	CHECK(argc > 1);
+	s_sim = host_shared(sizeof(*s_sim));
+
+	if (argc > 3 && strcmp(argv[2], "trace") == 0) {
+		e = replay(argv[1], argv[3]);
+		printf("%s: %.0f wakes, %.1f s radio, %.0f bytes per day\n",
+		    argv[3], e.wakes, e.radio_s, e.bytes);
+		return 0;
+	}
+	if (update) {
+		printf("# trace wakes/day radio_s/day bytes/day\n");
+	}
+	for (int i = 0; i < sizeof(s_traces) / sizeof(s_traces[0]); i++) {
+		e = replay(argv[1], s_traces[i]);
+		if (update) {
+			printf("%s %.0f %.1f %.0f\n", s_traces[i], e.wakes,
+			    e.radio_s, e.bytes);
+			continue;
+		}
+
+		printf("%s: %.0f wakes, %.1f s radio, %.0f bytes per day\n",
+		    s_traces[i], e.wakes, e.radio_s, e.bytes);
+		CHECK(baseline_get(argv[1], s_traces[i], &base));
+		ok &= check("wakes", e.wakes, base.wakes);
+		ok &= check("radio s", e.radio_s, base.radio_s);
+		ok &= check("bytes", e.bytes, base.bytes);
+	}
+
+	return ok ? 0 : 1;
+}
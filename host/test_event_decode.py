@@ -0,0 +1,44 @@
+#!/usr/bin/env python3
+#
+# Round trip of the binary event log: the firmware records and dumps the
+# events in the host build (test_event_log lines), tools/event_decode.py
+# renders them with the formats of main/events.h like the formatted log
+# of the firmware.
+#
+#   test_event_decode.py path/to/test_event_log
+#
+
+import os
+import subprocess
+import sys
+
+TOOLS = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..",
+                     "tools")
+
+
+def main():
+    out = subprocess.run([sys.argv[1], "lines"], check=True,
+                         stdout=subprocess.PIPE,
+                         universal_newlines=True).stdout.splitlines()
+    evlog = [line for line in out if line.startswith("EVLOG:")]
+    want = [line[len("EXPECT "):] for line in out
+            if line.startswith("EXPECT ")]
+    assert len(evlog) > 1 and len(want) >= len(evlog), out
+
+    # the console around, a log prefix and a malformed line are skipped
+    console = ["boot log"]
+    for line in evlog:
+        console += ["I (1234) app_main: Entering deep sleep",
+                    "I (5) boot: " + line]
+    console.insert(2, "EVLOG:zz")
+    got = subprocess.run([sys.executable,
+                          os.path.join(TOOLS, "event_decode.py")],
+                         input="\n".join(console) + "\n", check=True,
+                         stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                         universal_newlines=True)
+    assert got.stdout.splitlines() == want, (got.stdout, want)
+    assert "malformed" in got.stderr
+
+
+if __name__ == "__main__":
+    main()
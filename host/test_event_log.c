@@ -0,0 +1,282 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "event_log.h"
+#include "host.h"
+#include "rtc_arena.h"
+#include "sdkconfig.h"
+
+
+#define S 1000000LL
+#define START 1700000000
+
+/* one dumped entry, main/event_log.c */
+#define ENTRY_SIZE 16
+
+#define OUT_SIZE (16 + 2 * ENTRY_SIZE * CONFIG_EVENT_LOG_SIZE)
+
+/* an event logged by a boot */
+typedef struct {
+	event_id_t id;
+	uint32_t a;
+	uint32_t b;
+} event_arg_t;
+
+/* the dump of the last boot, shared with the boots */
+typedef struct {
+	char text[OUT_SIZE];
+	int entries;
+	uint32_t time[CONFIG_EVENT_LOG_SIZE];
+	uint32_t id[CONFIG_EVENT_LOG_SIZE];
+	uint32_t arg[CONFIG_EVENT_LOG_SIZE][2];
+} out_t;
+
+static out_t *s_out;
+
+static const char *s_format[EV_MAX] = {
+#define EVENT(id, format) [id] = format,
+	EVENTS
+#undef EVENT
+};
+
+
+/*
+ * The wake commits the ring before the deep sleep.
+ */
+static int log_event(void *arg)
+{
+	const event_arg_t *e = arg;
+
+	event_log(e->id, e->a, e->b);
+	rtc_arena_commit_all();
+
+	return 0;
+}
+
+/*
+ * A brownout before the sleep.
+ */
+static int log_cut(void *arg)
+{
+	const event_arg_t *e = arg;
+
+	event_log(e->id, e->a, e->b);
+	host_cut();
+}
+
+static uint32_t le32(const char *hex)
+{
+	unsigned byte;
+	uint32_t v = 0;
+
+	for (int i = 3; i >= 0; i--) {
+		CHECK(sscanf(hex + 2 * i, "%2x", &byte) == 1);
+		v = v << 8 | byte;
+	}
+
+	return v;
+}
+
+/*
+ * Catch the EVLOG line event_log_dump() prints and parse its entries.
+ */
+static int dump(void *arg)
+{
+	FILE *f = tmpfile();
+	int saved = dup(STDOUT_FILENO);
+	size_t len;
+	const char *hex;
+
+	CHECK(f != NULL && saved >= 0);
+	fflush(stdout);
+	dup2(fileno(f), STDOUT_FILENO);
+	event_log_dump();
+	fflush(stdout);
+	dup2(saved, STDOUT_FILENO);
+	close(saved);
+
+	rewind(f);
+	len = fread(s_out->text, 1, sizeof(s_out->text) - 1, f);
+	s_out->text[len] = '\0';
+	fclose(f);
+
+	s_out->entries = 0;
+	if (len == 0) {
+		return 0;
+	}
+
+	CHECK(strncmp(s_out->text, "EVLOG:", 6) == 0);
+	hex = s_out->text + 6;
+	CHECK((strlen(hex) - 1) % (2 * ENTRY_SIZE) == 0);
+	for (int i = 0; hex[0] != '\n'; i++, hex += 2 * ENTRY_SIZE) {
+		s_out->time[i] = le32(hex);
+		s_out->id[i] = le32(hex + 8) & 0xffff;
+		s_out->arg[i][0] = le32(hex + 16);
+		s_out->arg[i][1] = le32(hex + 24);
+		s_out->entries++;
+	}
+
+	return 0;
+}
+
+static void boot(int (*fn)(void *), void *arg)
+{
+	CHECK(host_boot(ESP_RST_DEEPSLEEP, fn, arg) == 0);
+}
+
+/*
+ * The events of several wakes are dumped once, a second dump is empty.
+ */
+static void test_pending()
+{
+	event_arg_t e[] = {
+		{ EV_POST, 3, 456 },
+		{ EV_POST_STATUS, 204, 0 },
+		{ EV_BUDGET_SPENT, 7, 0 },
+	};
+
+	host_power_off();
+	host_clock_set(START * S);
+	for (int i = 0; i < 3; i++) {
+		host_clock_advance(60 * S);
+		boot(log_event, &e[i]);
+	}
+
+	boot(dump, NULL);
+	CHECK(s_out->entries == 3);
+	for (int i = 0; i < 3; i++) {
+		CHECK(s_out->time[i] == START + 60 * (i + 1));
+		CHECK(s_out->id[i] == e[i].id);
+		CHECK(s_out->arg[i][0] == e[i].a && s_out->arg[i][1] == e[i].b);
+	}
+
+	boot(dump, NULL);
+	CHECK(s_out->entries == 0 && s_out->text[0] == '\0');
+
+	/* the events are not committed one by one, the brownout loses them */
+	boot(log_event, &e[0]);
+	CHECK(host_boot(ESP_RST_DEEPSLEEP, log_cut, &e[1]) == HOST_CUT);
+	boot(dump, NULL);
+	CHECK(s_out->entries == 0);
+
+	/* the power off loses the ring */
+	boot(log_event, &e[0]);
+	host_power_off();
+	boot(dump, NULL);
+	CHECK(s_out->entries == 0);
+}
+
+/*
+ * The oldest events are overwritten when the ring is full.
+ */
+static void test_wrap()
+{
+	event_arg_t e = { EV_HTTP_DATA, 0, 0 };
+
+	host_power_off();
+	for (int i = 0; i < CONFIG_EVENT_LOG_SIZE + 4; i++) {
+		e.a = i;
+		boot(log_event, &e);
+	}
+
+	boot(dump, NULL);
+	CHECK(s_out->entries == CONFIG_EVENT_LOG_SIZE);
+	for (int i = 0; i < CONFIG_EVENT_LOG_SIZE; i++) {
+		CHECK(s_out->arg[i][0] == i + 4);
+	}
+}
+
+/*
+ * For test_event_decode.py: the EVLOG lines of a few wakes, each followed
+ * by the events formatted like the log without EVENT_LOG,
+ * "EXPECT <date> <time> <id>: <text>".
+ */
+static void lines()
+{
+	event_arg_t e[] = {
+		{ EV_HTTP_CONNECTED, 0, 0 },
+		{ EV_HTTP_HEADER, 17, 0 },
+		{ EV_POST, 8, 1234 },
+		{ EV_POST_STATUS, 204, 0 },
+		{ EV_DELTA_TOO_LONG, 0, 0 },
+		{ EV_POST_OVERFLOW, 0, 0 },
+		{ EV_BUDGET_SPENT, 24, 0 },
+		{ EV_HTTP_DISCONNECTED, 0, 0 },
+	};
+	static const char *name[EV_MAX] = {
+#define EVENT(id, format) [id] = #id,
+		EVENTS
+#undef EVENT
+	};
+	int n = sizeof(e) / sizeof(e[0]);
+	char text[96];
+	char stamp[32];
+	time_t t;
+
+	host_power_off();
+	host_clock_set(START * S);
+	for (int i = 0; i < n; i++) {
+		host_clock_advance(61 * S);
+		boot(log_event, &e[i]);
+		if (i % 3 != 2 && i != n - 1) {
+			continue;
+		}
+
+		boot(dump, NULL);
+		printf("%s", s_out->text);
+		for (int j = 0; j < s_out->entries; j++) {
+			t = s_out->time[j];
+			strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S",
+			    gmtime(&t));
+			snprintf(text, sizeof(text), s_format[s_out->id[j]],
+			    s_out->arg[j][0], s_out->arg[j][1]);
+			printf("EXPECT %s %s: %s\n", stamp,
+			    name[s_out->id[j]], text);
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	s_out = host_shared(sizeof(*s_out));
+
+	if (argc > 1 && strcmp(argv[1], "lines") == 0) {
+		lines();
+		return 0;
+	}
+
+	test_pending();
+	test_wrap();
+
+	return 0;
+}
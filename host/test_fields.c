@@ -0,0 +1,233 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "fields.h"
+#include "host.h"
+#include "sample_buf.h"
+#include "sdkconfig.h"
+#include "upload.h"
+
+
+#define S 1000000LL
+
+#define TEMP (1 << SAMPLE_TEMP)
+#define PRES (1 << SAMPLE_PRES)
+
+/* the fields of the requests posted by upload_send() */
+static uint32_t s_posted;
+
+
+static void push(float temp, float pres)
+{
+	float value[SAMPLE_FIELDS] = { [SAMPLE_TEMP] = temp,
+	    [SAMPLE_PRES] = pres };
+
+	sample_buf_push(time(NULL), value, 0);
+}
+
+static uint32_t due(bool changed)
+{
+	bool c;
+	uint32_t mask = fields_due(&c);
+
+	CHECK(c == changed);
+
+	return mask;
+}
+
+/*
+ * Upload the buffer like upload_send() does.
+ */
+static void sent(uint32_t mask)
+{
+	fields_sent(mask);
+	sample_buf_drop(sample_buf_count());
+}
+
+/*
+ * Every field is due by its cadence, earlier on the change over its
+ * threshold.
+ */
+static int cadence(void *arg)
+{
+	float f[SAMPLE_FIELDS] = { [SAMPLE_TEMP] = 20.4,
+	    [SAMPLE_PRES] = 1000 };
+
+	/* never sent */
+	push(20, 1000);
+	CHECK(due(false) == (TEMP | PRES));
+	CHECK(!fields_alert(f));
+
+	/* nothing sent without a sample */
+	sample_buf_drop(1);
+	fields_sent(TEMP | PRES);
+	push(20, 1000);
+	CHECK(due(false) == (TEMP | PRES));
+	sent(TEMP | PRES);
+
+	/* under the thresholds */
+	host_clock_advance(60 * S);
+	push(20.4, 1000.9);
+	CHECK(due(false) == 0);
+	CHECK(!fields_alert(f));
+
+	/* the temperature moved, the pressure waits */
+	host_clock_advance(60 * S);
+	push(19.4, 1000.5);
+	CHECK(due(true) == TEMP);
+	f[SAMPLE_TEMP] = 19.4;
+	CHECK(fields_alert(f));
+	sent(TEMP);
+	CHECK(!fields_alert(f));
+
+	/* the temperature cadence */
+	host_clock_advance(CONFIG_TEMP_CADENCE * S);
+	push(19.4, 1000.5);
+	CHECK(due(false) == TEMP);
+	sent(TEMP);
+
+	/* the pressure moved from its last upload, not from the last sample */
+	host_clock_advance(60 * S);
+	push(19.4, 998.9);
+	CHECK(due(true) == PRES);
+	sent(PRES);
+
+	/* the pressure cadence */
+	host_clock_advance(CONFIG_PRES_CADENCE * S);
+	push(19.4, 998.9);
+	CHECK(due(false) == (TEMP | PRES));
+	sent(TEMP | PRES);
+
+	/* the clock was set backwards, all are due */
+	host_clock_advance(-3600 * S);
+	push(19.4, 998.9);
+	CHECK(due(false) == (TEMP | PRES));
+
+	return 0;
+}
+
+/*
+ * The last upload is kept over the deep sleep.
+ */
+static int sent_before(void *arg)
+{
+	push(20, 1000);
+	sent(TEMP | PRES);
+
+	return 0;
+}
+
+static int due_after(void *arg)
+{
+	push(20.1, 1000.1);
+
+	return due(false);
+}
+
+static esp_err_t post(const char *data, size_t len, int n)
+{
+	s_posted |= strstr(data, " temp=") != NULL ? TEMP : 0;
+	s_posted |= strstr(data, " pres=") != NULL ? PRES : 0;
+
+	return ESP_OK;
+}
+
+static uint32_t upload(bool forced)
+{
+	s_posted = 0;
+	CHECK(upload_send(post, INT64_MAX, forced) == ESP_OK);
+
+	return s_posted;
+}
+
+/*
+ * The ULP wake sends only the fields due, nothing while none is. The
+ * deadline or the full buffer forces all the fields out.
+ */
+static int forced(void *arg)
+{
+	int n = sample_buf_count();
+
+	push(20.1, 1000.1);
+	CHECK(upload(false) == 0);
+	CHECK(sample_buf_count() == n + 1);
+
+	push(21, 1000.1);
+	CHECK(upload(false) == TEMP);
+	CHECK(sample_buf_count() == 0);
+
+	push(21, 1000.1);
+	CHECK(upload(true) == (TEMP | PRES));
+	CHECK(sample_buf_count() == 0);
+
+	return 0;
+}
+
+/*
+ * The points carry the precision of their field.
+ */
+static int precision(void *arg)
+{
+	sample_t sample = {
+		.time = 1700000000,
+		.count = 1,
+		.field = {
+			[SAMPLE_TEMP] = { 20.126, 20.126, 20.126 },
+			[SAMPLE_PRES] = { 1013.26, 1013.26, 1013.26 },
+		},
+	};
+	char buf[256];
+	size_t len = 0;
+
+	upload_encode_line(buf, sizeof(buf), &len, SAMPLE_TEMP, &sample);
+	upload_encode_line(buf, sizeof(buf), &len, SAMPLE_PRES, &sample);
+	CHECK(strstr(buf, " temp=20.13 1700000000\n") != NULL);
+	CHECK(strstr(buf, " pres=1013.3 1700000000\n") != NULL);
+
+	return 0;
+}
+
+int main()
+{
+	host_power_off();
+	host_clock_set(1700000000 * S);
+	CHECK(host_boot(ESP_RST_POWERON, cadence, NULL) == 0);
+
+	host_power_off();
+	CHECK(host_boot(ESP_RST_POWERON, sent_before, NULL) == 0);
+	host_clock_advance(60 * S);
+	CHECK(host_boot(ESP_RST_DEEPSLEEP, due_after, NULL) == 0);
+	CHECK(host_boot(ESP_RST_DEEPSLEEP, forced, NULL) == 0);
+
+	CHECK(host_boot(ESP_RST_DEEPSLEEP, precision, NULL) == 0);
+
+	return 0;
+}
@@ -0,0 +1,308 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdbool.h>
+#include <time.h>
+
+#include "flush_sched.h"
+#include "host.h"
+#include "sample_buf.h"
+#include "sdkconfig.h"
+#include "wake_cycle.h"
+
+
+#define S 1000000LL
+#define HOUR (3600 * S)
+
+/* shared by the test and the boots */
+typedef struct {
+	bool link_up;
+	int posts;		/* requests one upload gets through, 0 all */
+	int posted;
+	int wakes;
+	int timer_wakes;
+	int attempts;
+	int left;		/* samples buffered after the last wake */
+} sim_t;
+
+static sim_t *s_sim;
+
+
+static esp_err_t connect()
+{
+	s_sim->attempts++;
+	s_sim->posted = 0;
+	flush_sched_record(s_sim->link_up, -60, 0,
+	    s_sim->link_up ? 500 : CONFIG_WIFI_CONNECT_TIMEOUT);
+
+	return s_sim->link_up ? ESP_OK : ESP_FAIL;
+}
+
+/*
+ * The link drops after the posts requests.
+ */
+static esp_err_t post(const char *data, size_t len, int n)
+{
+	if (s_sim->posts > 0 && s_sim->posted == s_sim->posts) {
+		return ESP_FAIL;
+	}
+	s_sim->posted++;
+
+	return ESP_OK;
+}
+
+/*
+ * One wake of app_main.
+ */
+static int wake(void *arg)
+{
+	float value[SAMPLE_FIELDS] = { 20, 1000 };
+	const wake_cycle_t cycle = {
+		.connect = connect,
+		.post = post,
+		.budget_end = (int64_t)CONFIG_UPLOAD_BUDGET_MS * 1000
+	};
+
+	wake_cycle_run(value, &cycle);
+	s_sim->left = sample_buf_count();
+
+	return 0;
+}
+
+/*
+ * Run the interleaved timer and ULP wakes (every ulp s, 0 none) for the
+ * duration (us).
+ */
+static void run(int64_t duration, int ulp)
+{
+	int64_t end = host_clock() + duration;
+	int64_t next_ulp = ulp ? host_clock() + ulp * S : INT64_MAX;
+	int64_t next_timer;
+
+	for (;;) {
+		next_timer = host_clock() + host_timer_wakeup();
+		if (next_timer > end && next_ulp > end) {
+			break;
+		}
+		if (next_timer <= next_ulp) {
+			host_clock_set(next_timer);
+			s_sim->timer_wakes++;
+		} else {
+			/* the ULP wake restarts the timer */
+			host_clock_set(next_ulp);
+			next_ulp += ulp * S;
+		}
+		s_sim->wakes++;
+		CHECK(host_boot(ESP_RST_DEEPSLEEP, wake, NULL) == 0);
+	}
+
+	host_clock_set(end);
+}
+
+/* one connection attempt for record() */
+typedef struct {
+	bool connected;
+	int8_t rssi;
+	int retries;
+	uint32_t connect_ms;
+} attempt_t;
+
+/*
+ * Record the attempt, returns the cost (s) rounded.
+ */
+static int record(void *arg)
+{
+	const attempt_t *a = arg;
+
+	flush_sched_record(a->connected, a->rssi, a->retries, a->connect_ms);
+
+	return (flush_sched_cost() + 500) / 1000;
+}
+
+static int attempt(bool connected, int8_t rssi, int retries,
+    uint32_t connect_ms)
+{
+	attempt_t a = { connected, rssi, retries, connect_ms };
+
+	return host_boot(ESP_RST_DEEPSLEEP, record, &a);
+}
+
+/*
+ * Push a sample, returns whether the flush is due.
+ */
+static int push_due(void *arg)
+{
+	float value[SAMPLE_FIELDS] = { 20, 1000 };
+
+	sample_buf_push(time(NULL), value, 0);
+
+	return flush_sched_due(false);
+}
+
+/*
+ * Push a sample every period s, returns the buffered samples at the first
+ * due flush.
+ */
+static int due_after(int period)
+{
+	for (int n = 1; n <= CONFIG_SAMPLE_BUF_SIZE; n++) {
+		host_clock_advance(period * S);
+		if (host_boot(ESP_RST_DEEPSLEEP, push_due, NULL) != 0) {
+			return n;
+		}
+	}
+
+	return 0;
+}
+
+static void reset(bool link_up, int posts)
+{
+	host_power_off();
+	host_nvs_erase();
+	*s_sim = (sim_t){ .link_up = link_up, .posts = posts };
+	CHECK(host_boot(ESP_RST_POWERON, wake, NULL) == 0);
+}
+
+/*
+ * With the link down the stale batch is retried with the backoff, not on
+ * every MIN_SLEEP wake.
+ */
+static void test_link_down()
+{
+	int attempts;
+
+	reset(false, 0);
+	run(12 * HOUR, 0);
+	/* the heartbeats, the backoff from 1 min up to the heartbeat period */
+	CHECK(s_sim->timer_wakes <= 12 + 8);
+	CHECK(s_sim->attempts == s_sim->wakes + 1);
+
+	/* with the ULP wakes in between, the backoff keeps going */
+	reset(false, 0);
+	run(12 * HOUR, 7 * 60);
+	CHECK(s_sim->timer_wakes <= 12 + 8);
+
+	/* the link is back, the next retry sends all */
+	attempts = s_sim->attempts;
+	s_sim->link_up = true;
+	run(CONFIG_SAFE_TIMER * S, 7 * 60);
+	CHECK(s_sim->attempts > attempts);
+	CHECK(s_sim->left == 0);
+}
+
+/*
+ * The link drops after the priority request and one chunk, the stale rest
+ * waits for the backoff too. The oldest left gets stale again at most once
+ * per period.
+ */
+static void test_partial()
+{
+	reset(true, 2);
+	s_sim->link_up = false;
+	run(2 * HOUR, 0);
+	s_sim->link_up = true;
+	s_sim->wakes = 0;
+	s_sim->timer_wakes = 0;
+	run(12 * HOUR, 0);
+	CHECK(s_sim->timer_wakes <= 2 * 12 + 8);
+}
+
+/*
+ * The connect cost follows the recorded attempts with the 1/4 weight of
+ * the newest one. A failure counts all the retries, a weak signal doubles
+ * the cost.
+ */
+static void test_cost()
+{
+	host_power_off();
+	host_nvs_erase();
+	CHECK(attempt(true, -60, 2, 1500) == 4);	/* 1.5 + 2 * 1 */
+	CHECK(attempt(true, -60, 0, 500) == 3);		/* 1.25 + 1.5 */
+	CHECK(attempt(false, 0, 0, 15000) == 7);	/* 4.69 + 2.63 */
+	for (int i = 0; i < 16; i++) {
+		attempt(true, -60, 0, 500);
+	}
+	CHECK(attempt(true, -60, 0, 500) == 1);
+
+	host_power_off();
+	CHECK(attempt(true, -90, 0, 1000) == 2);
+	CHECK(attempt(true, -60, 0, 1000) == 2);	/* -82 dBm */
+	CHECK(attempt(true, -60, 0, 1000) == 1);	/* -76 dBm */
+}
+
+/*
+ * The samples wait until the connect cost shared by them is below
+ * LINK_SAMPLE_COST_MS, or the oldest one gets stale.
+ */
+static void test_defer()
+{
+	/* a cheap link sends every sample */
+	host_power_off();
+	host_nvs_erase();
+	attempt(true, -60, 0, 500);
+	CHECK(due_after(60) == 1);
+
+	/* 7.3 s, four samples share it */
+	host_power_off();
+	attempt(true, -60, 2, 1500);
+	attempt(true, -60, 0, 500);
+	attempt(false, 0, 0, 15000);
+	CHECK(due_after(60) == 4);
+
+	/* 21 s needs 11 samples, the first gets stale after 6 periods */
+	host_power_off();
+	attempt(false, 0, 0, 15000);
+	CHECK(due_after(CONFIG_FLUSH_STALE / 6) == 7);
+	host_power_off();
+	attempt(false, 0, 0, 15000);
+	CHECK(due_after(60) == 11);
+}
+
+/*
+ * A healthy link keeps the heartbeat grid and no retries.
+ */
+static void test_link_up()
+{
+	reset(true, 0);
+	run(24 * HOUR, 0);
+	CHECK(s_sim->timer_wakes == 24);
+	CHECK(s_sim->attempts == 25);
+}
+
+int main()
+{
+	s_sim = host_shared(sizeof(*s_sim));
+
+	test_cost();
+	test_defer();
+	test_link_up();
+	test_link_down();
+	test_partial();
+
+	return 0;
+}
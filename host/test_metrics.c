@@ -0,0 +1,140 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+#include "metrics.h"
+#include "sleep_mode.h"
+
+
+#define LABELS "{site=\"mysite\",place=\"myplace\"}"
+
+static const char expected[] =
+    "# TYPE temp_sensor_temperature_celsius gauge\n"
+    "temp_sensor_temperature_celsius" LABELS " -12.35\n"
+    "# TYPE temp_sensor_pressure_pascals gauge\n"
+    "temp_sensor_pressure_pascals" LABELS " 101325\n"
+    "# TYPE temp_sensor_wake_interval_seconds gauge\n"
+    "temp_sensor_wake_interval_seconds" LABELS " 61.005\n"
+    "# TYPE temp_sensor_free_heap_bytes gauge\n"
+    "temp_sensor_free_heap_bytes" LABELS " 123456\n";
+
+
+static void test_format()
+{
+	char buf[512];
+
+	CHECK(metrics_format(buf, sizeof(buf), -12.345, 1013.25, 61005,
+	    123456) == strlen(expected));
+	CHECK(strcmp(buf, expected) == 0);
+
+	/* the terminating zero does not fit */
+	CHECK(metrics_format(buf, strlen(expected), -12.345, 1013.25, 61005,
+	    123456) == -1);
+}
+
+/*
+ * Every sample is a "name{labels} value" line announced by its TYPE line
+ * before, the names in the base units.
+ */
+static void test_exposition()
+{
+	char buf[512];
+	char type[64];
+	char *line;
+	char *end;
+	int samples = 0;
+
+	CHECK(metrics_format(buf, sizeof(buf), 21.5, 950.01, 0, 0) > 0);
+
+	type[0] = '\0';
+	for (line = strtok(buf, "\n"); line != NULL;
+	    line = strtok(NULL, "\n")) {
+		if (sscanf(line, "# TYPE %63s gauge", type) == 1) {
+			continue;
+		}
+		CHECK(type[0] != '\0');
+		CHECK(strncmp(line, type, strlen(type)) == 0);
+		CHECK(strncmp(line + strlen(type), LABELS " ",
+		    strlen(LABELS " ")) == 0);
+		strtod(line + strlen(type) + strlen(LABELS " "), &end);
+		CHECK(*end == '\0');
+		type[0] = '\0';
+		samples++;
+	}
+	CHECK(samples == 4);
+}
+
+static int wake(void *arg)
+{
+	sleep_mode_wake();
+
+	return 0;
+}
+
+static int serve(void *arg)
+{
+	char buf[512];
+	int len;
+
+	sleep_mode_wake();
+	metrics_update(-12.345, 1013.25);
+	metrics_start();
+	len = host_httpd_get("/metrics", buf, sizeof(buf) - 1);
+	metrics_stop();
+
+	if (len < 0) {
+		return 1;
+	}
+	buf[len] = '\0';
+
+	return strcmp(buf, expected) == 0 ? 0 : 2;
+}
+
+/*
+ * The server answers with the body preformatted by the update.
+ */
+static void test_serve()
+{
+	host_power_off();
+	CHECK(host_boot(ESP_RST_POWERON, wake, NULL) == 0);
+	host_clock_advance(61005000);
+	CHECK(host_boot(ESP_RST_DEEPSLEEP, serve, NULL) == 0);
+}
+
+int main()
+{
+	test_format();
+	test_exposition();
+	test_serve();
+
+	return 0;
+}
@@ -0,0 +1,418 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Power cut injection of the wake cycle. A scenario of wakes with a link
+ * outage and a settings update is replayed once per write boundary of
+ * every wake: the RTC arena commit steps, the NVS writes and the server
+ * storing a request. The power is cut there, the device restarts on the
+ * brownout and the scenario goes on until the buffer is drained. Every
+ * sample pushed before the cut has to reach the server, a sample sent
+ * twice has to be the same point, the buffer, the settings and the
+ * heartbeat grid stay consistent. The coverage of the cut points is
+ * printed.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "flush_sched.h"
+#include "host.h"
+#include "sample_buf.h"
+#include "sdkconfig.h"
+#include "settings.h"
+#include "wake_cycle.h"
+#include "wake_sched.h"
+
+
+#define S 1000000LL
+#define START 1700000000
+
+/* the power on boot and the timer wakes of the scenario */
+#define WAKES 9
+#define WAKE_S 60
+#define LINK_DOWN_FIRST 2
+#define LINK_DOWN_LAST 4
+#define SETTINGS_WAKE 6
+#define SETTINGS_DELTA "batch=2"
+
+#define DRAIN_MAX 8
+#define CONNECT_MS 1200
+
+#define PUSHES 64
+#define LINES 512
+#define LINE_LEN 160
+#define BOUNDARIES 512
+
+static const char *s_kinds[] = { "rtc", "nvs", "post" };
+
+#define KINDS (sizeof(s_kinds) / sizeof(s_kinds[0]))
+
+/* shared by the test and the boots */
+typedef struct {
+	/* the scenario */
+	int wake;
+	int cut;
+	bool link;
+	bool delta;		/* sent with the next response */
+	bool drain;
+	/* the server */
+	int lines;
+	char line[LINES][LINE_LEN];
+	/* the device */
+	int pushes;
+	uint32_t pending;	/* pushed by a boot the power cut */
+	int acked;
+	uint32_t acked_time[PUSHES];
+	uint32_t heartbeat;	/* the first one, the grid */
+	uint32_t batch;
+	int left;
+	int violations;
+} sim_t;
+
+static sim_t *s_sim;
+
+#define INVARIANT(cond) do { \
+	if (!(cond)) { \
+		printf("  wake %d cut %d: %s\n", s_sim->wake, s_sim->cut, \
+		    #cond); \
+		s_sim->violations++; \
+	} \
+} while (0)
+
+
+static esp_err_t connect()
+{
+	flush_sched_record(s_sim->link, -60, 0, CONNECT_MS);
+
+	return s_sim->link ? ESP_OK : ESP_FAIL;
+}
+
+/*
+ * The server stores the lines, the cut can take the response. The
+ * response carries the settings delta once.
+ */
+static esp_err_t post(const char *data, size_t len, int n)
+{
+	const char *end = data + len;
+	const char *p, *nl;
+	size_t l;
+	bool ulp_changed;
+
+	for (p = data; p < end; p = nl + 1) {
+		nl = memchr(p, '\n', end - p);
+		if (nl == NULL) {
+			nl = end;
+		}
+		l = nl - p;
+		CHECK(s_sim->lines < LINES && l < LINE_LEN);
+		memcpy(s_sim->line[s_sim->lines], p, l);
+		s_sim->line[s_sim->lines][l] = '\0';
+		s_sim->lines++;
+	}
+
+	host_boundary("post");
+
+	if (s_sim->delta) {
+		s_sim->delta = false;
+		settings_apply_delta(SETTINGS_DELTA, &ulp_changed);
+	}
+
+	return ESP_OK;
+}
+
+static void check_device()
+{
+	const settings_t *settings = settings_get();
+	uint32_t heartbeat = wake_sched_get(WAKE_HEARTBEAT);
+	int n = sample_buf_count();
+
+	for (int i = 1; i < n; i++) {
+		INVARIANT(sample_buf_get(i - 1)->time <
+		    sample_buf_get(i)->time);
+	}
+
+	INVARIANT(settings->batch == CONFIG_BATCH_SIZE ||
+	    settings->batch == 2);
+
+	if (s_sim->heartbeat == 0) {
+		s_sim->heartbeat = heartbeat;
+	}
+	INVARIANT(heartbeat >= s_sim->heartbeat && (heartbeat -
+	    s_sim->heartbeat) % settings->safe_timer == 0);
+
+	s_sim->batch = settings->batch;
+	s_sim->left = n;
+}
+
+static void ack(uint32_t t)
+{
+	CHECK(s_sim->acked < PUSHES);
+	s_sim->acked_time[s_sim->acked++] = t;
+}
+
+/*
+ * The sample of the boot the power cut counts when it reached the buffer,
+ * or the server before it was dropped.
+ */
+static void ack_pending()
+{
+	uint32_t t = s_sim->pending;
+	bool kept = false;
+	char stamp[16];
+
+	if (t == 0) {
+		return;
+	}
+	s_sim->pending = 0;
+
+	for (int i = 0; i < sample_buf_count(); i++) {
+		kept |= sample_buf_get(i)->time == t;
+	}
+	snprintf(stamp, sizeof(stamp), " %u", t);
+	for (int i = 0; i < s_sim->lines; i++) {
+		kept |= strstr(s_sim->line[i], stamp) != NULL;
+	}
+
+	if (kept) {
+		ack(t);
+	}
+}
+
+/*
+ * One wake of app_main. The values zigzag, so the compression keeps every
+ * point. The drain wakes are the passed flush deadlines.
+ */
+static int wake(void *arg)
+{
+	float value[SAMPLE_FIELDS];
+	uint32_t now = time(NULL);
+	int zig = s_sim->pushes++ % 2 ? 1 : -1;
+	const wake_cycle_t cycle = {
+		.connect = connect,
+		.post = post,
+		.budget_end = (int64_t)CONFIG_UPLOAD_BUDGET_MS * 1000
+	};
+
+	ack_pending();
+
+	value[SAMPLE_TEMP] = 20 + zig;
+	value[SAMPLE_PRES] = 1000 + zig;
+	if (s_sim->drain) {
+		wake_sched_set(WAKE_FLUSH, now);
+	}
+	s_sim->pending = now;
+	wake_cycle_run(value, &cycle);
+	s_sim->pending = 0;
+	ack(now);
+
+	check_device();
+
+	return 0;
+}
+
+static bool line_split(const char *line, char *field, size_t size,
+    uint32_t *t)
+{
+	const char *f = strchr(line, ' ');
+	const char *eq = f != NULL ? strchr(f, '=') : NULL;
+	const char *last = strrchr(line, ' ');
+
+	if (eq == NULL || last == f || eq - f - 1 >= size) {
+		return false;
+	}
+	memcpy(field, f + 1, eq - f - 1);
+	field[eq - f - 1] = '\0';
+	*t = strtoul(last + 1, NULL, 10);
+
+	return true;
+}
+
+/*
+ * Every acked sample is on the server with all the fields, the duplicates
+ * are the same points. Returns the re-sent lines.
+ */
+static int check_server()
+{
+	char field[16], other[16];
+	uint32_t t, u;
+	int resent = 0;
+	int found;
+
+	for (int i = 0; i < s_sim->lines; i++) {
+		INVARIANT(line_split(s_sim->line[i], field, sizeof(field), &t));
+		for (int j = 0; j < i; j++) {
+			if (line_split(s_sim->line[j], other, sizeof(other),
+			    &u) && u == t && strcmp(field, other) == 0) {
+				INVARIANT(strcmp(s_sim->line[i],
+				    s_sim->line[j]) == 0);
+				resent++;
+				break;
+			}
+		}
+	}
+
+	for (int a = 0; a < s_sim->acked; a++) {
+		found = 0;
+		for (int i = 0; i < s_sim->lines; i++) {
+			if (line_split(s_sim->line[i], field, sizeof(field),
+			    &t) && t == s_sim->acked_time[a]) {
+				found |= 1 << (strcmp(field, "temp") == 0 ?
+				    SAMPLE_TEMP : SAMPLE_PRES);
+			}
+		}
+		INVARIANT(found == (1 << SAMPLE_FIELDS) - 1);
+	}
+
+	return resent;
+}
+
+/*
+ * Replay the scenario, cut the wake at its boundary cut, 0 none. The
+ * boundary kinds of the wake are stored when kinds is not NULL. Returns
+ * the re-sent lines.
+ */
+static int scenario(int wake_cut, int cut, const char **kinds, int *count)
+{
+	esp_reset_reason_t reason;
+	int status;
+
+	memset(s_sim, 0, sizeof(*s_sim));
+	s_sim->cut = cut;
+	host_power_off();
+	host_nvs_erase();
+
+	for (int w = 0; w < WAKES; w++) {
+		host_clock_set((START + (int64_t)w * WAKE_S) * S);
+		s_sim->wake = w;
+		s_sim->link = w < LINK_DOWN_FIRST || w > LINK_DOWN_LAST;
+		if (w == SETTINGS_WAKE) {
+			s_sim->delta = true;
+		}
+
+		reason = w == 0 ? ESP_RST_POWERON : ESP_RST_DEEPSLEEP;
+		if (w == wake_cut) {
+			host_cut_at(cut);
+		}
+		status = host_boot(reason, wake, NULL);
+
+		if (kinds != NULL && w == wake_cut) {
+			*count = host_boundaries();
+			CHECK(*count <= BOUNDARIES);
+			for (int i = 0; i < *count; i++) {
+				kinds[i] = host_boundary_kind(i + 1);
+			}
+		}
+
+		if (status == HOST_CUT) {
+			/* the regions the power on boot made are kept */
+			host_clock_advance(S);
+			host_log_watch("initialized");
+			CHECK(host_boot(ESP_RST_BROWNOUT, wake, NULL) == 0);
+			INVARIANT(w == 0 || host_log_hits() == 0);
+			host_log_watch(NULL);
+		} else {
+			CHECK(status == 0);
+		}
+	}
+
+	s_sim->link = true;
+	s_sim->drain = true;
+	for (int i = 0; s_sim->left > 0; i++) {
+		CHECK(i < DRAIN_MAX);
+		host_clock_advance(WAKE_S * S);
+		CHECK(host_boot(ESP_RST_DEEPSLEEP, wake, NULL) == 0);
+	}
+
+	return check_server();
+}
+
+static int kind_index(const char *kind)
+{
+	for (int i = 0; i < KINDS; i++) {
+		if (strcmp(kind, s_kinds[i]) == 0) {
+			return i;
+		}
+	}
+
+	CHECK(!"unknown boundary kind");
+	return -1;
+}
+
+int main()
+{
+	const char *kinds[BOUNDARIES];
+	int count;
+	int points[WAKES][KINDS] = { { 0 } };
+	int total[KINDS] = { 0 };
+	int runs = 0;
+	int resent = 0;
+	int violations = 0;
+
+	s_sim = host_shared(sizeof(*s_sim));
+
+	/* the reference run without a cut */
+	CHECK(scenario(-1, 0, NULL, NULL) == 0);
+	CHECK(s_sim->violations == 0 && s_sim->batch == 2);
+
+	for (int w = 0; w < WAKES; w++) {
+		scenario(w, 0, kinds, &count);
+		for (int k = 1; k <= count; k++) {
+			resent += scenario(w, k, NULL, NULL);
+			violations += s_sim->violations;
+			points[w][kind_index(kinds[k - 1])]++;
+			runs++;
+		}
+	}
+
+	printf("power cut: %d runs, %d violations, %d re-sent lines\n",
+	    runs, violations, resent);
+	printf("  wake");
+	for (int i = 0; i < KINDS; i++) {
+		printf(" %5s", s_kinds[i]);
+	}
+	printf("\n");
+	for (int w = 0; w < WAKES; w++) {
+		printf("  %4d", w);
+		for (int i = 0; i < KINDS; i++) {
+			printf(" %5d", points[w][i]);
+			total[i] += points[w][i];
+		}
+		printf("\n");
+	}
+	printf("   all");
+	for (int i = 0; i < KINDS; i++) {
+		printf(" %5d", total[i]);
+		/* every kind of the boundaries was cut */
+		CHECK(total[i] > 0);
+	}
+	printf("\n");
+
+	return violations == 0 ? 0 : 1;
+}
@@ -0,0 +1,273 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include "host.h"
+#include "rtc_arena.h"
+#include "sdkconfig.h"
+
+
+/* the last word of every region, xor the first letter of its name */
+#define PATTERN 0x5a17c0de
+
+typedef struct {
+	const char *name;
+	size_t size;
+	uint16_t version;
+	int fresh;		/* expected, -1 any */
+	uint32_t value;		/* expected unless fresh, then written */
+	bool cut;		/* value + 1 too, the last commit was cut */
+	bool commit_all;
+} region_case_t;
+
+static region_case_t s_case;
+
+
+/*
+ * Get the region, check it and write the next value.
+ */
+static int use_region(void *arg)
+{
+	region_case_t *c = arg;
+	uint32_t *p;
+	bool fresh;
+
+	CHECK(rtc_arena_get(c->name, c->size, c->version, (void **)&p,
+	    &fresh) == ESP_OK);
+	if (c->fresh >= 0) {
+		CHECK(fresh == c->fresh);
+	}
+	if (fresh) {
+		for (size_t i = 0; i < c->size / 4; i++) {
+			CHECK(p[i] == 0);
+		}
+	} else {
+		CHECK(p[0] == c->value || (c->cut && p[0] == c->value + 1));
+	}
+
+	rtc_arena_begin(p);
+	p[0] = c->value + 1;
+	p[c->size / 4 - 1] = PATTERN ^ c->name[0];
+
+	if (c->commit_all) {
+		rtc_arena_commit_all();
+	} else {
+		rtc_arena_commit(p);
+	}
+
+	return 0;
+}
+
+static int boot(esp_reset_reason_t reason, const char *name, size_t size,
+    uint16_t version, int fresh, uint32_t value)
+{
+	s_case.name = name;
+	s_case.size = size;
+	s_case.version = version;
+	s_case.fresh = fresh;
+	s_case.value = value;
+
+	return host_boot(reason, use_region, &s_case);
+}
+
+/*
+ * Flip one bit of the PATTERN of the region in the RTC memory, and of its
+ * stale copies in the undo.
+ */
+static void corrupt_pattern(char name, int offset)
+{
+	size_t size;
+	uint8_t *rtc = host_rtc(&size);
+	uint32_t word;
+	bool found = false;
+
+	for (size_t i = 0; i + 4 <= size; i += 4) {
+		memcpy(&word, rtc + i, 4);
+		if (word == (PATTERN ^ name)) {
+			rtc[i + offset] ^= 0x10;
+			found = true;
+		}
+	}
+
+	CHECK(found);
+}
+
+static void test_deep_sleep(bool commit_all)
+{
+	s_case.commit_all = commit_all;
+
+	host_power_off();
+	CHECK(boot(ESP_RST_POWERON, "a", 16, 1, 1, 0) == 0);
+	CHECK(boot(ESP_RST_DEEPSLEEP, "a", 16, 1, 0, 1) == 0);
+	CHECK(boot(ESP_RST_BROWNOUT, "a", 16, 1, 0, 2) == 0);
+	CHECK(boot(ESP_RST_SW, "a", 16, 1, 0, 3) == 0);
+
+	/* the power on never trusts the random content */
+	CHECK(boot(ESP_RST_POWERON, "a", 16, 1, 1, 0) == 0);
+
+	s_case.commit_all = false;
+}
+
+static void test_regions()
+{
+	host_power_off();
+	CHECK(boot(ESP_RST_POWERON, "a", 16, 1, 1, 0) == 0);
+	CHECK(boot(ESP_RST_DEEPSLEEP, "b", 32, 1, 1, 0) == 0);
+	CHECK(boot(ESP_RST_DEEPSLEEP, "c", 16, 1, 1, 0) == 0);
+	CHECK(boot(ESP_RST_DEEPSLEEP, "a", 16, 1, 0, 1) == 0);
+	CHECK(boot(ESP_RST_DEEPSLEEP, "b", 32, 1, 0, 1) == 0);
+	CHECK(boot(ESP_RST_DEEPSLEEP, "c", 16, 1, 0, 1) == 0);
+}
+
+static void test_corruption()
+{
+	size_t size;
+
+	/* data of the region b */
+	test_regions();
+	corrupt_pattern('b', 0);
+	CHECK(boot(ESP_RST_DEEPSLEEP, "b", 32, 1, 1, 0) == 0);
+	CHECK(boot(ESP_RST_DEEPSLEEP, "a", 16, 1, 0, 2) == 0);
+	CHECK(boot(ESP_RST_DEEPSLEEP, "c", 16, 1, 0, 2) == 0);
+
+	/* anywhere in the header, it is restored from its copy or reset */
+	for (size_t i = 0; i < 64; i++) {
+		test_regions();
+		host_rtc(&size)[i] ^= 0x01;
+		CHECK(boot(ESP_RST_DEEPSLEEP, "a", 16, 1, -1, 2) == 0);
+	}
+}
+
+static void test_layout_change()
+{
+	/* the version of b changed, the others stay */
+	test_regions();
+	CHECK(boot(ESP_RST_DEEPSLEEP, "b", 32, 2, 1, 0) == 0);
+	CHECK(boot(ESP_RST_DEEPSLEEP, "a", 16, 1, 0, 2) == 0);
+	CHECK(boot(ESP_RST_DEEPSLEEP, "c", 16, 1, 0, 2) == 0);
+	CHECK(boot(ESP_RST_DEEPSLEEP, "b", 32, 2, 0, 1) == 0);
+
+	/* b grows over c, it has to move */
+	test_regions();
+	CHECK(boot(ESP_RST_DEEPSLEEP, "b", 64, 1, 1, 0) == 0);
+	CHECK(boot(ESP_RST_DEEPSLEEP, "c", 16, 1, 0, 2) == 0);
+	CHECK(boot(ESP_RST_DEEPSLEEP, "a", 16, 1, 0, 2) == 0);
+	CHECK(boot(ESP_RST_DEEPSLEEP, "b", 64, 1, 0, 1) == 0);
+
+	/* c shrinks in place */
+	test_regions();
+	CHECK(boot(ESP_RST_DEEPSLEEP, "c", 8, 1, 1, 0) == 0);
+	CHECK(boot(ESP_RST_DEEPSLEEP, "b", 32, 1, 0, 2) == 0);
+	CHECK(boot(ESP_RST_DEEPSLEEP, "c", 8, 1, 0, 1) == 0);
+}
+
+/*
+ * The power cut at every step of a modification and of an allocation. The
+ * modified region is the old or the new one, the others are intact.
+ */
+static void test_cut()
+{
+	for (int k = 1; ; k++) {
+		test_regions();
+		host_cut_at(k);
+		if (boot(ESP_RST_DEEPSLEEP, "b", 32, 1, 0, 2) != HOST_CUT) {
+			CHECK(k > 2);
+			break;
+		}
+		s_case.cut = true;
+		CHECK(boot(ESP_RST_BROWNOUT, "b", 32, 1, 0, 2) == 0);
+		s_case.cut = false;
+		CHECK(boot(ESP_RST_DEEPSLEEP, "a", 16, 1, 0, 2) == 0);
+		CHECK(boot(ESP_RST_DEEPSLEEP, "c", 16, 1, 0, 2) == 0);
+	}
+
+	for (int k = 1; ; k++) {
+		test_regions();
+		host_cut_at(k);
+		if (boot(ESP_RST_DEEPSLEEP, "d", 16, 1, 1, 0) != HOST_CUT) {
+			CHECK(k > 2);
+			break;
+		}
+		CHECK(boot(ESP_RST_BROWNOUT, "a", 16, 1, 0, 2) == 0);
+		CHECK(boot(ESP_RST_BROWNOUT, "b", 32, 1, 0, 2) == 0);
+		CHECK(boot(ESP_RST_BROWNOUT, "c", 16, 1, 0, 2) == 0);
+		s_case.cut = true;
+		CHECK(boot(ESP_RST_BROWNOUT, "d", 16, 1, -1, 0) == 0);
+		s_case.cut = false;
+	}
+}
+
+/*
+ * A region over the space or the region count is kept in RAM, the module
+ * gets a usable zeroed memory anyway.
+ */
+static int exhaust(void *arg)
+{
+	uint8_t *p;
+	bool fresh = false;
+	char name[RTC_ARENA_NAME_LEN];
+
+	CHECK(rtc_arena_get("big", CONFIG_RTC_ARENA_SIZE + 4, 1, (void **)&p,
+	    &fresh) == ESP_ERR_NO_MEM);
+	CHECK(p != NULL && fresh);
+	for (size_t i = 0; i < CONFIG_RTC_ARENA_SIZE + 4; i++) {
+		CHECK(p[i] == 0);
+	}
+
+	CHECK(rtc_arena_get("fits", CONFIG_RTC_ARENA_SIZE - 64, 1, (void **)&p,
+	    &fresh) == ESP_OK);
+
+	for (int i = 0; ; i++) {
+		snprintf(name, sizeof(name), "r%d", i);
+		fresh = false;
+		if (rtc_arena_get(name, 4, 1, (void **)&p, &fresh) != ESP_OK) {
+			CHECK(p != NULL && fresh);
+			break;
+		}
+		CHECK(i < 64);
+	}
+
+	return 0;
+}
+
+int main()
+{
+	test_deep_sleep(false);
+	test_deep_sleep(true);
+	test_regions();
+	test_corruption();
+	test_layout_change();
+	test_cut();
+
+	host_power_off();
+	CHECK(boot(ESP_RST_POWERON, "a", 16, 1, 1, 0) == 0);
+	CHECK(host_boot(ESP_RST_DEEPSLEEP, exhaust, NULL) == 0);
+
+	return 0;
+}
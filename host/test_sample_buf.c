@@ -0,0 +1,200 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <math.h>
+
+#include "host.h"
+#include "sample_buf.h"
+#include "sdkconfig.h"
+
+
+#define PUSHES (CONFIG_SAMPLE_BUF_SIZE * 40)
+#define PERIOD 60
+
+/* raw sample n of the test series */
+static uint32_t raw_time(int n)
+{
+	return 1600000000 + n * PERIOD;
+}
+
+static float raw_temp(int n)
+{
+	return n * 0.25f;
+}
+
+static float raw_pres(int n)
+{
+	return 1000 + n % 17;
+}
+
+static bool raw_alert(int n)
+{
+	return n % 37 == 5;
+}
+
+static void push(int n)
+{
+	float value[SAMPLE_FIELDS] = {
+		[SAMPLE_TEMP] = raw_temp(n),
+		[SAMPLE_PRES] = raw_pres(n),
+	};
+
+	sample_buf_push(raw_time(n), value, raw_alert(n) ? SAMPLE_ALERT : 0);
+}
+
+static bool near(float a, float b)
+{
+	return fabsf(a - b) <= 1e-4f * fmaxf(1, fabsf(b));
+}
+
+/*
+ * The buckets cover the raw samples first..first + pushes - 1 whole and in
+ * order, every one exact over its span.
+ */
+static void check_cover(int first, int pushes)
+{
+	int n = first;
+
+	for (int i = 0; i < sample_buf_count(); i++) {
+		const sample_t *s = sample_buf_get(i);
+		int last = n + s->count - 1;
+		uint64_t time = 0;
+		double temp = 0;
+		float pres_min = INFINITY;
+		float pres_max = -INFINITY;
+		bool alert = false;
+
+		CHECK(s->count >= 1);
+		/* the resolution decreases towards the oldest */
+		if (i > 0) {
+			CHECK(s->count <= sample_buf_get(i - 1)->count);
+		}
+
+		for (int k = n; k <= last; k++) {
+			time += raw_time(k);
+			temp += raw_temp(k);
+			pres_min = fminf(pres_min, raw_pres(k));
+			pres_max = fmaxf(pres_max, raw_pres(k));
+			alert |= raw_alert(k);
+		}
+
+		CHECK(s->field[SAMPLE_TEMP].min == raw_temp(n));
+		CHECK(s->field[SAMPLE_TEMP].max == raw_temp(last));
+		CHECK(near(s->field[SAMPLE_TEMP].mean, temp / s->count));
+		CHECK(s->field[SAMPLE_PRES].min == pres_min);
+		CHECK(s->field[SAMPLE_PRES].max == pres_max);
+		CHECK(s->field[SAMPLE_PRES].min <= s->field[SAMPLE_PRES].mean &&
+		    s->field[SAMPLE_PRES].mean <= s->field[SAMPLE_PRES].max);
+		/* the mean time, rounded down at every merge */
+		CHECK(s->time <= time / s->count &&
+		    s->time + 8 >= time / s->count);
+		CHECK(!!(s->flags & SAMPLE_ALERT) == alert);
+
+		n = last + 1;
+	}
+
+	CHECK(n == first + pushes);
+}
+
+static int fill(void *arg)
+{
+	int *pushed = arg;
+
+	for (int n = 0; n < PUSHES; n++) {
+		push(n);
+		CHECK(sample_buf_count() ==
+		    (n < CONFIG_SAMPLE_BUF_SIZE ? n + 1 : CONFIG_SAMPLE_BUF_SIZE));
+		check_cover(0, n + 1);
+	}
+	*pushed = PUSHES;
+
+	return 0;
+}
+
+/*
+ * The next boot finds the buffer as left, drops the sent oldest buckets and
+ * keeps going.
+ */
+static int resume(void *arg)
+{
+	int *pushed = arg;
+	int first = 0;
+
+	check_cover(0, *pushed);
+
+	for (int i = 0; i < 3; i++) {
+		first += sample_buf_get(i)->count;
+	}
+	sample_buf_drop(3);
+	check_cover(first, *pushed - first);
+
+	for (int n = *pushed; n < *pushed + CONFIG_SAMPLE_BUF_SIZE; n++) {
+		push(n);
+		check_cover(first, n + 1 - first);
+	}
+
+	return 0;
+}
+
+static int remove_sent(void *arg)
+{
+	uint32_t time[3];
+
+	sample_buf_drop(sample_buf_count());
+	for (int n = 0; n < 3; n++) {
+		push(n);
+		time[n] = sample_buf_get(n)->time;
+	}
+
+	/* the priority lane removes a sample from the middle */
+	sample_buf_remove(1);
+	CHECK(sample_buf_count() == 2);
+	CHECK(sample_buf_get(0)->time == time[0]);
+	CHECK(sample_buf_get(1)->time == time[2]);
+
+	sample_buf_remove(2);
+	CHECK(sample_buf_count() == 2);
+
+	sample_buf_shift_time(-100);
+	CHECK(sample_buf_get(0)->time == time[0] - 100);
+	CHECK(sample_buf_get(1)->time == time[2] - 100);
+
+	return 0;
+}
+
+int main()
+{
+	int *pushed = host_shared(sizeof(*pushed));
+
+	host_power_off();
+	CHECK(host_boot(ESP_RST_POWERON, fill, pushed) == 0);
+	CHECK(host_boot(ESP_RST_DEEPSLEEP, resume, pushed) == 0);
+	CHECK(host_boot(ESP_RST_DEEPSLEEP, remove_sent, NULL) == 0);
+
+	return 0;
+}
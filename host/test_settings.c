@@ -0,0 +1,185 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include "nvs.h"
+
+#include "host.h"
+#include "sdkconfig.h"
+#include "settings.h"
+
+
+/* the blob of the first version, the raw settings without the version */
+typedef struct {
+	uint32_t t_diff;
+	uint32_t p_diff;
+	uint32_t period;
+	uint32_t batch;
+	uint32_t safe_timer;
+	uint32_t flush_stale;
+} settings_v1_t;
+
+
+static void nvs_store(const void *blob, size_t len)
+{
+	nvs_handle_t nvs;
+
+	CHECK(nvs_open("temp_sensor", NVS_READWRITE, &nvs) == ESP_OK);
+	CHECK(nvs_set_blob(nvs, "settings", blob, len) == ESP_OK);
+	nvs_close(nvs);
+}
+
+static int check_defaults(void *arg)
+{
+	const settings_t *s = settings_get();
+
+	CHECK(s->t_diff == CONFIG_BMP_TDIFF);
+	CHECK(s->p_diff == CONFIG_BMP_PDIFF);
+	CHECK(s->t_diff_c == CONFIG_BMP_CALIB_TDIFF);
+	CHECK(s->p_diff_pa == CONFIG_BMP_CALIB_PDIFF);
+	CHECK(s->period == CONFIG_BMP_PERIOD);
+	CHECK(s->batch == CONFIG_BATCH_SIZE);
+	CHECK(s->safe_timer == CONFIG_SAFE_TIMER);
+	CHECK(s->flush_stale == CONFIG_FLUSH_STALE);
+
+	return 0;
+}
+
+static int apply(void *arg)
+{
+	bool ulp_changed;
+
+	CHECK(settings_apply_delta("pdiff_pa=50,timer=600", &ulp_changed) ==
+	    ESP_OK);
+	CHECK(ulp_changed);
+	CHECK(settings_get()->p_diff_pa == 50);
+	CHECK(settings_get()->safe_timer == 600);
+
+	return 0;
+}
+
+static int check_applied(void *arg)
+{
+	bool ulp_changed;
+
+	CHECK(settings_get()->p_diff_pa == 50);
+	CHECK(settings_get()->safe_timer == 600);
+
+	/* the raw difference takes over from the calibrated one */
+	CHECK(settings_apply_delta("pdiff=12", &ulp_changed) == ESP_OK);
+	CHECK(ulp_changed);
+	CHECK(settings_get()->p_diff == 12);
+	CHECK(settings_get()->p_diff_pa == 0);
+	CHECK(settings_get()->t_diff_c == CONFIG_BMP_CALIB_TDIFF);
+
+	return 0;
+}
+
+static int check_raw(void *arg)
+{
+	CHECK(settings_get()->p_diff == 12);
+	CHECK(settings_get()->p_diff_pa == 0);
+
+	return 0;
+}
+
+static int parse(void *arg)
+{
+	bool ulp_changed;
+	char longer[256];
+
+	/* unknown keys are ignored, the spaces after the commas skipped */
+	CHECK(settings_apply_delta("foo=1, batch=4", &ulp_changed) == ESP_OK);
+	CHECK(!ulp_changed);
+	CHECK(settings_get()->batch == 4);
+
+	/* one bad value rejects all */
+	CHECK(settings_apply_delta("batch=5,period=0", &ulp_changed) ==
+	    ESP_ERR_INVALID_ARG);
+	CHECK(settings_get()->batch == 4);
+	CHECK(settings_apply_delta("batch=5x", &ulp_changed) ==
+	    ESP_ERR_INVALID_ARG);
+	CHECK(settings_apply_delta("batch=", &ulp_changed) ==
+	    ESP_ERR_INVALID_ARG);
+	CHECK(settings_apply_delta("batch", &ulp_changed) ==
+	    ESP_ERR_INVALID_ARG);
+	CHECK(settings_apply_delta("timer=59", &ulp_changed) ==
+	    ESP_ERR_INVALID_ARG);
+	CHECK(settings_apply_delta("pdiff_pa=10001", &ulp_changed) ==
+	    ESP_ERR_INVALID_ARG);
+	CHECK(settings_get()->batch == 4);
+
+	memset(longer, 'a', sizeof(longer) - 1);
+	longer[sizeof(longer) - 1] = '\0';
+	CHECK(settings_apply_delta(longer, &ulp_changed) ==
+	    ESP_ERR_INVALID_SIZE);
+
+	/* the same values again change nothing */
+	CHECK(settings_apply_delta("tdiff=20,period=5", &ulp_changed) ==
+	    ESP_OK);
+	CHECK(ulp_changed);
+	CHECK(settings_apply_delta("tdiff=20,period=5", &ulp_changed) ==
+	    ESP_OK);
+	CHECK(!ulp_changed);
+
+	return 0;
+}
+
+int main()
+{
+	settings_v1_t v1 = { 20, 39, 5, 1, 3600, 3600 };
+	uint32_t other[9] = { 1 };
+
+	host_nvs_erase();
+	host_power_off();
+	CHECK(host_boot(ESP_RST_POWERON, check_defaults, NULL) == 0);
+
+	/* applied, kept over the sleep and the power off */
+	CHECK(host_boot(ESP_RST_DEEPSLEEP, apply, NULL) == 0);
+	CHECK(host_boot(ESP_RST_DEEPSLEEP, check_applied, NULL) == 0);
+	host_power_off();
+	CHECK(host_boot(ESP_RST_POWERON, check_raw, NULL) == 0);
+
+	/* the blob of the first version is in other units */
+	host_nvs_erase();
+	nvs_store(&v1, sizeof(v1));
+	host_power_off();
+	CHECK(host_boot(ESP_RST_POWERON, check_defaults, NULL) == 0);
+
+	/* a version mark of another layout */
+	host_nvs_erase();
+	nvs_store(other, sizeof(other));
+	host_power_off();
+	CHECK(host_boot(ESP_RST_POWERON, check_defaults, NULL) == 0);
+
+	host_nvs_erase();
+	host_power_off();
+	CHECK(host_boot(ESP_RST_POWERON, parse, NULL) == 0);
+
+	return 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "host.h"
+#include "sdkconfig.h"
+#include "sleep_mode.h"
+
+
+#define S 1000000LL
+
+/* the break even of the sdkconfig.h energies and the hysteresis */
+#define BREAK_EVEN_S 30
+#define LEAVE_S 45
+
+/* the result of the last wake, shared with the boots */
+typedef struct {
+	sleep_mode_t mode;
+	uint32_t interval;
+} result_t;
+
+static result_t *s_result;
+
+
+static int wake(void *arg)
+{
+	sleep_mode_wake();
+
+	return 0;
+}
+
+static int wake_interval(void *arg)
+{
+	sleep_mode_wake();
+
+	return sleep_mode_interval() / 1000;
+}
+
+/*
+ * The clock set over SNTP moves the last wake by the same step, the wake
+ * interval does not see the step.
+ */
+static int set_clock(void *arg)
+{
+	int32_t step = 1700000000 - host_clock() / S;
+
+	host_clock_set(host_clock() + step * S);
+	sleep_mode_shift_time(step);
+
+	return 0;
+}
+
+static int wake_mode(void *arg)
+{
+	s_result->mode = sleep_mode_wake();
+	s_result->interval = sleep_mode_interval();
+	CHECK(sleep_mode_get() == s_result->mode);
+
+	return 0;
+}
+
+/*
+ * Wake n times every period s, the mode follows the averaged interval
+ * against the thresholds. Returns the wakes until the mode changed.
+ */
+static int wakes(int n, int period)
+{
+	sleep_mode_t mode = s_result->mode;
+
+	for (int i = 1; i <= n; i++) {
+		host_clock_advance(period * S);
+		CHECK(host_boot(ESP_RST_DEEPSLEEP, wake_mode, NULL) == 0);
+		if (mode == SLEEP_MODE_DEEP) {
+			CHECK((s_result->mode == SLEEP_MODE_CONNECTED) ==
+			    (s_result->interval < BREAK_EVEN_S * 1000));
+		} else {
+			CHECK((s_result->mode == SLEEP_MODE_DEEP) ==
+			    (s_result->interval > LEAVE_S * 1000));
+		}
+		if (s_result->mode != mode) {
+			return i;
+		}
+	}
+
+	return 0;
+}
+
+static void test_switch()
+{
+	host_power_off();
+	host_clock_set(1700000000 * S);
+	CHECK(host_boot(ESP_RST_POWERON, wake_mode, NULL) == 0);
+	CHECK(s_result->mode == SLEEP_MODE_DEEP);
+
+	/* calm, the first interval starts the average */
+	CHECK(wakes(8, 60) == 0);
+	CHECK(s_result->interval == 60000);
+
+	/* a burst of the ULP wakes, the average follows in a few wakes */
+	CHECK(wakes(8, 5) > 1);
+	CHECK(s_result->mode == SLEEP_MODE_CONNECTED);
+
+	/* between the thresholds the mode stays */
+	CHECK(wakes(16, (BREAK_EVEN_S + LEAVE_S) / 2) == 0);
+	CHECK(s_result->mode == SLEEP_MODE_CONNECTED);
+
+	/* calm again */
+	CHECK(wakes(8, 120) > 0);
+	CHECK(s_result->mode == SLEEP_MODE_DEEP);
+	CHECK(wakes(16, (BREAK_EVEN_S + LEAVE_S) / 2) == 0);
+
+	/* the power on starts over in the deep sleep */
+	CHECK(wakes(8, 5) > 0);
+	CHECK(host_boot(ESP_RST_POWERON, wake_mode, NULL) == 0);
+	CHECK(s_result->mode == SLEEP_MODE_DEEP &&
+	    s_result->interval == UINT32_MAX);
+}
+
+static void test_shift_time()
+{
+	host_power_off();
+	host_clock_set(100 * S);
+	CHECK(host_boot(ESP_RST_POWERON, wake, NULL) == 0);
+	host_clock_advance(60 * S);
+	CHECK(host_boot(ESP_RST_DEEPSLEEP, wake_interval, NULL) == 60);
+
+	CHECK(host_boot(ESP_RST_DEEPSLEEP, set_clock, NULL) == 0);
+	host_clock_advance(60 * S);
+	CHECK(host_boot(ESP_RST_DEEPSLEEP, wake_interval, NULL) == 60);
+}
+
+int main()
+{
+	s_result = host_shared(sizeof(*s_result));
+
+	test_switch();
+	test_shift_time();
+
+	return 0;
+}
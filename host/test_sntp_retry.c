@@ -0,0 +1,124 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <time.h>
+#include "host.h"
+#include "sdkconfig.h"
+#include "sntp_retry.h"
+
+
+#define S 1000000LL
+
+/* the server does not answer, count the attempts */
+static int *s_attempts;
+
+
+/*
+ * One upload wake with the SNTP unreachable or answering.
+ */
+static int sync_wake(void *arg)
+{
+	bool synced = (arg != NULL);
+
+	if (sntp_retry_due(time(NULL))) {
+		(*s_attempts)++;
+		sntp_retry_done(synced, time(NULL));
+	}
+
+	return 0;
+}
+
+/*
+ * The upload wakes every period s for the time s, returns the attempts.
+ */
+static int wakes(int period, int total, void *synced)
+{
+	*s_attempts = 0;
+	for (int t = 0; t < total; t += period) {
+		CHECK(host_boot(ESP_RST_DEEPSLEEP, sync_wake, synced) == 0);
+		host_clock_advance(period * S);
+	}
+
+	return *s_attempts;
+}
+
+static void test_backoff()
+{
+	host_power_off();
+	host_clock_set(0);
+	*s_attempts = 0;
+	CHECK(host_boot(ESP_RST_POWERON, sync_wake, NULL) == 0);
+	CHECK(*s_attempts == 1);
+
+	/* 5, 10, 20 and 40 min after the failures, not the 12 wakes */
+	host_clock_advance(60 * S);
+	CHECK(wakes(60, 75 * 60, NULL) == 4);
+
+	/* the interval stops at the maximum, a day on the 10 min wakes */
+	CHECK(wakes(600, 24 * 3600, NULL) <=
+	    24 * 3600 / CONFIG_SNTP_BACKOFF_MAX + 2);
+
+	/* the power on starts over */
+	host_power_off();
+	*s_attempts = 0;
+	CHECK(host_boot(ESP_RST_POWERON, sync_wake, NULL) == 0);
+	CHECK(*s_attempts == 1);
+}
+
+static void test_synced()
+{
+	host_power_off();
+	host_clock_set(0);
+	CHECK(host_boot(ESP_RST_POWERON, sync_wake, NULL) == 0);
+	host_clock_advance(300 * S);
+
+	/* the success resets the backoff, the clock is not set by the test */
+	CHECK(wakes(60, 600, (void *)1) == 10);
+}
+
+static void test_clock_back()
+{
+	host_power_off();
+	host_clock_set(100000 * S);
+	CHECK(wakes(60, 60, NULL) == 1);
+
+	/* the clock moved back past the backoff, try again */
+	host_clock_set(100 * S);
+	CHECK(wakes(60, 60, NULL) == 1);
+}
+
+int main()
+{
+	s_attempts = host_shared(sizeof(*s_attempts));
+
+	test_backoff();
+	test_synced();
+	test_clock_back();
+
+	return 0;
+}
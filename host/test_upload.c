@@ -0,0 +1,259 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "esp_timer.h"
+
+#include "fields.h"
+#include "host.h"
+#include "sample_buf.h"
+#include "sdkconfig.h"
+#include "upload.h"
+
+
+#define S 1000000LL
+#define SAMPLES 20
+#define ALERT 3
+#define REQUESTS 16
+
+/* one request the server got */
+typedef struct {
+	int n;
+	int points;
+	uint32_t time[SAMPLES];	/* of the temp points */
+} request_t;
+
+/* shared by the test and the boots */
+typedef struct {
+	int64_t post_us;	/* simulated time of one request */
+	bool fail;
+	int count;
+	request_t request[REQUESTS];
+	int sent[SAMPLES];	/* temp points of each sample */
+} server_t;
+
+static server_t *s_server;
+
+
+static uint32_t sample_time(int i)
+{
+	return 1700000000 + i * 60;
+}
+
+/* zigzag, the compression keeps every point */
+static float sample_temp(int i)
+{
+	return 20 + i % 2;
+}
+
+static esp_err_t post(const char *data, size_t len, int n)
+{
+	request_t *r = &s_server->request[s_server->count++];
+	const char *line;
+	char buf[256];
+	unsigned t;
+
+	CHECK(s_server->count <= REQUESTS);
+	CHECK(data[len] == '\0' && strlen(data) == len);
+
+	host_clock_advance(s_server->post_us);
+	if (s_server->fail) {
+		return ESP_FAIL;
+	}
+
+	r->n = n;
+	for (line = data; *line != '\0'; line = strchr(line, '\n') + 1) {
+		CHECK(strchr(line, '\n') != NULL);
+		CHECK(strchr(line, '\n') - line < sizeof(buf));
+		strlcpy(buf, line, strchr(line, '\n') - line + 1);
+		if (strncmp(strchr(buf, ' '), " temp=", 6) != 0) {
+			continue;
+		}
+		/* the server time without the timestamp */
+		if (sscanf(strchr(buf, ' '), " temp=%*f %u", &t) != 1) {
+			t = 0;
+		}
+		r->time[r->points++] = t;
+		if (t != 0) {
+			s_server->sent[(t - sample_time(0)) / 60]++;
+		}
+	}
+
+	return ESP_OK;
+}
+
+static void fill()
+{
+	float value[SAMPLE_FIELDS];
+
+	host_power_off();
+	memset(s_server, 0, sizeof(*s_server));
+	host_clock_set(sample_time(0) * S);
+
+	for (int i = 0; i < SAMPLES; i++) {
+		value[SAMPLE_TEMP] = sample_temp(i);
+		value[SAMPLE_PRES] = 1000;
+		sample_buf_push(sample_time(i), value,
+		    i == ALERT ? SAMPLE_ALERT : 0);
+	}
+}
+
+/*
+ * The alert and the latest sample go first, the history then from the
+ * oldest.
+ */
+static int send_all(void *arg)
+{
+	float latest[SAMPLE_FIELDS] = { sample_temp(SAMPLES - 1), 1000 };
+	float older[SAMPLE_FIELDS] = { sample_temp(SAMPLES - 2), 1000 };
+	request_t *r = s_server->request;
+
+	fill();
+	host_clock_advance(SAMPLES * 60 * S);
+
+	CHECK(upload_send(post, esp_timer_get_time() + 60 * S, true) == ESP_OK);
+	CHECK(sample_buf_count() == 0);
+
+	CHECK(s_server->count == 4);
+	CHECK(r[0].n == 2 && r[0].points == 2);
+	CHECK(r[0].time[0] == sample_time(ALERT));
+	CHECK(r[0].time[1] == sample_time(SAMPLES - 1));
+	CHECK(r[1].n == CONFIG_UPLOAD_CHUNK && r[2].n == CONFIG_UPLOAD_CHUNK);
+	CHECK(r[3].n == SAMPLES - 2 - 2 * CONFIG_UPLOAD_CHUNK);
+
+	/* the history in order, oldest first */
+	for (int i = 1; i < s_server->count; i++) {
+		for (int j = 1; j < r[i].points; j++) {
+			CHECK(r[i].time[j] > r[i].time[j - 1]);
+		}
+		if (i > 1) {
+			CHECK(r[i].time[0] > r[i - 1].time[r[i - 1].points - 1]);
+		}
+	}
+	for (int i = 0; i < SAMPLES; i++) {
+		CHECK(s_server->sent[i] == 1);
+	}
+
+	/* the latest value is the last uploaded, not the last of the history */
+	CHECK(!fields_alert(latest));
+	CHECK(fields_alert(older));
+
+	return 0;
+}
+
+/*
+ * The budget ends the history, the next wake goes on from the oldest left.
+ */
+static int send_budget(void *arg)
+{
+	fill();
+	s_server->post_us = 2 * S;
+
+	/* the priority request, two history chunks */
+	CHECK(upload_send(post, esp_timer_get_time() + 5 * S, true) == ESP_OK);
+	CHECK(s_server->count == 3);
+	CHECK(sample_buf_count() == SAMPLES - 2 - 2 * CONFIG_UPLOAD_CHUNK);
+	CHECK(sample_buf_get(0)->time == sample_time(1 + 2 * CONFIG_UPLOAD_CHUNK));
+
+	return 0;
+}
+
+static int send_rest(void *arg)
+{
+	CHECK(upload_send(post, esp_timer_get_time() + 5 * S, true) == ESP_OK);
+	CHECK(sample_buf_count() == 0);
+	CHECK(s_server->count == 4);
+	for (int i = 0; i < SAMPLES; i++) {
+		CHECK(s_server->sent[i] == 1);
+	}
+
+	return 0;
+}
+
+/*
+ * A failed request keeps the samples and the last uploaded values.
+ */
+static int send_fail(void *arg)
+{
+	float latest[SAMPLE_FIELDS] = { sample_temp(SAMPLES - 1), 1000 };
+
+	fill();
+	s_server->fail = true;
+
+	CHECK(upload_send(post, esp_timer_get_time() + 5 * S, true) == ESP_FAIL);
+	CHECK(s_server->count == 1);
+	CHECK(sample_buf_count() == SAMPLES);
+	/* never uploaded, no alert */
+	CHECK(!fields_alert(latest));
+
+	return 0;
+}
+
+/*
+ * Before the clock is set the points have no time, one request carries the
+ * latest only so they do not overwrite each other.
+ */
+static int send_unset_clock(void *arg)
+{
+	float value[SAMPLE_FIELDS] = { 20, 1000 };
+
+	host_power_off();
+	memset(s_server, 0, sizeof(*s_server));
+	host_clock_set(10 * S);
+	for (int i = 0; i < 5; i++) {
+		sample_buf_push(time(NULL), value, i == 1 ? SAMPLE_ALERT : 0);
+		host_clock_advance(60 * S);
+	}
+
+	CHECK(upload_send(post, esp_timer_get_time() + 60 * S, true) == ESP_OK);
+	CHECK(s_server->count == 1);
+	CHECK(s_server->request[0].n == 1);
+	CHECK(s_server->request[0].points == 1);
+	CHECK(s_server->request[0].time[0] == 0);
+
+	/* the rest waits for the clock */
+	CHECK(sample_buf_count() == 4);
+	CHECK(sample_buf_get(3)->time == 10 + 3 * 60);
+
+	return 0;
+}
+
+int main()
+{
+	s_server = host_shared(sizeof(*s_server));
+
+	CHECK(host_boot(ESP_RST_POWERON, send_all, NULL) == 0);
+	CHECK(host_boot(ESP_RST_POWERON, send_budget, NULL) == 0);
+	CHECK(host_boot(ESP_RST_DEEPSLEEP, send_rest, NULL) == 0);
+	CHECK(host_boot(ESP_RST_POWERON, send_fail, NULL) == 0);
+	CHECK(host_boot(ESP_RST_POWERON, send_unset_clock, NULL) == 0);
+
+	return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "esp_wifi.h"
+#include "host.h"
+#include "sdkconfig.h"
+#include "wifi_retry.h"
+
+
+#define MS 1000LL
+
+static void test_backoff()
+{
+	wifi_retry_t retry;
+	uint32_t delay;
+	uint32_t base = CONFIG_WIFI_RETRY_BASE_MS;
+	int64_t now = 0;
+
+	wifi_retry_init(&retry, now);
+
+	for (int i = 0; i < CONFIG_MAXIMUM_RETRY; i++) {
+		/* the lowest and the highest jitter */
+		wifi_retry_t low = retry;
+
+		CHECK(wifi_retry_next(&low, WIFI_REASON_BEACON_TIMEOUT, now,
+		    0, &delay) == WIFI_RETRY_DELAY);
+		CHECK(delay == base / 2);
+		CHECK(wifi_retry_next(&retry, WIFI_REASON_BEACON_TIMEOUT, now,
+		    base / 2, &delay) == WIFI_RETRY_DELAY);
+		CHECK(delay == base);
+
+		base *= 2;
+		if (base > CONFIG_WIFI_RETRY_MAX_MS) {
+			base = CONFIG_WIFI_RETRY_MAX_MS;
+		}
+		now += MS;
+	}
+
+	CHECK(wifi_retry_next(&retry, WIFI_REASON_BEACON_TIMEOUT, now, 0,
+	    &delay) == WIFI_RETRY_ABORT);
+}
+
+/*
+ * Way past the width of the shift, the delay stays at the maximum.
+ */
+static void test_many_attempts()
+{
+	wifi_retry_t retry;
+	uint32_t delay;
+
+	for (int attempt = 10; attempt < CONFIG_MAXIMUM_RETRY + 40; attempt++) {
+		wifi_retry_init(&retry, 0);
+		retry.attempt = attempt;
+		if (attempt >= CONFIG_MAXIMUM_RETRY) {
+			CHECK(wifi_retry_next(&retry, WIFI_REASON_ASSOC_LEAVE,
+			    0, UINT32_MAX, &delay) == WIFI_RETRY_ABORT);
+			continue;
+		}
+		CHECK(wifi_retry_next(&retry, WIFI_REASON_ASSOC_LEAVE, 0,
+		    CONFIG_WIFI_RETRY_MAX_MS / 2, &delay) == WIFI_RETRY_DELAY);
+		CHECK(delay == CONFIG_WIFI_RETRY_MAX_MS);
+	}
+}
+
+static void test_reasons()
+{
+	wifi_retry_t retry;
+	uint32_t delay;
+
+	/* wrong credentials */
+	wifi_retry_init(&retry, 0);
+	CHECK(wifi_retry_next(&retry, WIFI_REASON_AUTH_FAIL, 0, 0,
+	    &delay) == WIFI_RETRY_ABORT);
+	wifi_retry_init(&retry, 0);
+	CHECK(wifi_retry_next(&retry, WIFI_REASON_802_1X_AUTH_FAILED, 0, 0,
+	    &delay) == WIFI_RETRY_ABORT);
+
+	/* probably wrong credentials, one more try */
+	wifi_retry_init(&retry, 0);
+	CHECK(wifi_retry_next(&retry, WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT, 0, 0,
+	    &delay) == WIFI_RETRY_DELAY);
+	CHECK(wifi_retry_next(&retry, WIFI_REASON_HANDSHAKE_TIMEOUT, 0, 0,
+	    &delay) == WIFI_RETRY_ABORT);
+
+	/* the AP moved to another channel */
+	wifi_retry_init(&retry, 0);
+	CHECK(wifi_retry_next(&retry, WIFI_REASON_NO_AP_FOUND, 0, 0,
+	    &delay) == WIFI_RETRY_RESCAN);
+}
+
+static void test_time_limit()
+{
+	wifi_retry_t retry;
+	uint32_t delay;
+	int64_t start = 5000 * MS;
+	int64_t now = start + (CONFIG_WIFI_CONNECT_TIMEOUT - 100) * MS;
+
+	/* the delay is cut to the time left */
+	wifi_retry_init(&retry, start);
+	CHECK(wifi_retry_next(&retry, WIFI_REASON_BEACON_TIMEOUT, now,
+	    UINT32_MAX, &delay) == WIFI_RETRY_DELAY);
+	CHECK(delay <= 100);
+
+	now = start + CONFIG_WIFI_CONNECT_TIMEOUT * MS;
+	CHECK(wifi_retry_next(&retry, WIFI_REASON_BEACON_TIMEOUT, now, 0,
+	    &delay) == WIFI_RETRY_ABORT);
+}
+
+int main()
+{
+	test_backoff();
+	test_many_attempts();
+	test_reasons();
+	test_time_limit();
+
+	return 0;
+}
@@ -0,0 +1,205 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_bt.h"
+#include "esp_bt_main.h"
+#include "esp_gap_ble_api.h"
+#include "nvs_flash.h"
+#include "sdkconfig.h"
+
+#include "ble_adv.h"
+#include "rtc_arena.h"
+
+
+#define SEQ_VERSION 1
+
+/* flags and the manufacturer specific data AD structures */
+#define ADV_LEN (3 + 2 + BLE_ADV_PAYLOAD_LEN)
+
+/* 100ms in 0.625ms units, the shortest non connectable advertising interval */
+#define ADV_INTERVAL 0xa0
+
+#define ADV_TIMEOUT_MS 1000
+
+
+typedef struct {
+	uint16_t seq;
+	float temp;
+	float pres;
+	uint8_t battery;
+} adv_data_t;
+
+/* never deleted, the GAP callback may give it after the timeout */
+static SemaphoreHandle_t s_adv_sem;
+static esp_err_t s_adv_err;
+
+static esp_ble_adv_params_t s_adv_params = {
+	.adv_int_min = ADV_INTERVAL,
+	.adv_int_max = ADV_INTERVAL,
+	.adv_type = ADV_TYPE_NONCONN_IND,
+	.own_addr_type = BLE_ADDR_TYPE_PUBLIC,
+	.channel_map = ADV_CHNL_ALL,
+	.adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY,
+};
+
+
+static int32_t clamp(float v, int32_t min, int32_t max)
+{
+	long r = lroundf(v);
+
+	return r < min ? min : (r > max ? max : r);
+}
+
+/*
+ * Encode the data into the manufacturer specific payload of ble_adv.h.
+ */
+static void adv_encode(const adv_data_t *data, uint8_t *buf)
+{
+	int32_t temp = clamp(data->temp * 100, INT16_MIN, INT16_MAX);
+	int32_t pres = clamp(data->pres * 100, 0, 0xffffff);
+
+	buf[0] = CONFIG_BLE_COMPANY_ID & 0xff;
+	buf[1] = CONFIG_BLE_COMPANY_ID >> 8;
+	buf[2] = BLE_ADV_VERSION;
+	buf[3] = data->seq & 0xff;
+	buf[4] = data->seq >> 8;
+	buf[5] = temp & 0xff;
+	buf[6] = (temp >> 8) & 0xff;
+	buf[7] = pres & 0xff;
+	buf[8] = (pres >> 8) & 0xff;
+	buf[9] = (pres >> 16) & 0xff;
+	buf[10] = data->battery;
+}
+
+static void gap_event_handler(esp_gap_ble_cb_event_t event,
+    esp_ble_gap_cb_param_t *param)
+{
+	switch (event) {
+		case ESP_GAP_BLE_ADV_DATA_RAW_SET_COMPLETE_EVT:
+			if (param->adv_data_raw_cmpl.status ==
+			    ESP_BT_STATUS_SUCCESS &&
+			    esp_ble_gap_start_advertising(&s_adv_params) ==
+			    ESP_OK) {
+				break;
+			}
+			ESP_LOGE(__func__, "advertising data not set");
+			s_adv_err = ESP_FAIL;
+			xSemaphoreGive(s_adv_sem);
+			break;
+		case ESP_GAP_BLE_ADV_START_COMPLETE_EVT:
+			if (param->adv_start_cmpl.status !=
+			    ESP_BT_STATUS_SUCCESS) {
+				ESP_LOGE(__func__, "advertising start failed");
+				s_adv_err = ESP_FAIL;
+			}
+			xSemaphoreGive(s_adv_sem);
+			break;
+		default:
+			break;
+	}
+}
+
+static esp_err_t ble_start()
+{
+	esp_err_t ret;
+	esp_bt_controller_config_t bt_cfg = BT_CONTROLLER_INIT_CONFIG_DEFAULT();
+
+	ret = nvs_flash_init();
+	if (ret == ESP_ERR_NVS_NO_FREE_PAGES ||
+	    ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+		ESP_ERROR_CHECK(nvs_flash_erase());
+		ret = nvs_flash_init();
+	}
+	ESP_ERROR_CHECK(ret);
+
+	ESP_ERROR_CHECK(esp_bt_controller_mem_release(ESP_BT_MODE_CLASSIC_BT));
+	ESP_ERROR_CHECK(esp_bt_controller_init(&bt_cfg));
+	ESP_ERROR_CHECK(esp_bt_controller_enable(ESP_BT_MODE_BLE));
+	ESP_ERROR_CHECK(esp_bluedroid_init());
+	ESP_ERROR_CHECK(esp_bluedroid_enable());
+	ESP_ERROR_CHECK(esp_ble_gap_register_callback(gap_event_handler));
+
+	return ESP_OK;
+}
+
+esp_err_t ble_adv_send(const sample_t *sample)
+{
+	bool fresh;
+	uint16_t *seq;
+	uint8_t adv[ADV_LEN] = {
+		2, ESP_BLE_AD_TYPE_FLAG,
+		ESP_BLE_ADV_FLAG_GEN_DISC | ESP_BLE_ADV_FLAG_BREDR_NOT_SPT,
+		1 + BLE_ADV_PAYLOAD_LEN, ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE
+	};
+	adv_data_t data = {
+		.temp = sample->field[SAMPLE_TEMP].mean,
+		.pres = sample->field[SAMPLE_PRES].mean,
+		.battery = 0
+	};
+
+	rtc_arena_get("ble_seq", sizeof(*seq), SEQ_VERSION, (void **)&seq,
+	    &fresh);
+	rtc_arena_begin(seq);
+	data.seq = (*seq)++;
+	rtc_arena_commit(seq);
+
+	adv_encode(&data, adv + 5);
+
+	if (s_adv_sem == NULL) {
+		s_adv_sem = xSemaphoreCreateBinary();
+	}
+	/* a give of the previous send that came late */
+	xSemaphoreTake(s_adv_sem, 0);
+	s_adv_err = ESP_OK;
+
+	ble_start();
+	ESP_ERROR_CHECK(esp_ble_gap_config_adv_data_raw(adv, ADV_LEN));
+
+	if (xSemaphoreTake(s_adv_sem, pdMS_TO_TICKS(ADV_TIMEOUT_MS)) !=
+	    pdTRUE) {
+		ESP_LOGE(__func__, "advertising did not start");
+		esp_ble_gap_stop_advertising();
+		return ESP_ERR_TIMEOUT;
+	}
+	if (s_adv_err != ESP_OK) {
+		return s_adv_err;
+	}
+
+	ESP_LOGI(__func__, "advertising seq %u", data.seq);
+
+	vTaskDelay(pdMS_TO_TICKS(CONFIG_BLE_ADV_DURATION));
+	esp_ble_gap_stop_advertising();
+
+	return ESP_OK;
+}
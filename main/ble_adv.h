@@ -0,0 +1,58 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef BLE_ADV_H
+#define BLE_ADV_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#include "sample_buf.h"
+
+/*
+ * Manufacturer specific data of the advertisement, all little endian:
+ *
+ *   0  company id (2)	CONFIG_BLE_COMPANY_ID
+ *   2  version (1)	BLE_ADV_VERSION
+ *   3  sequence (2)	incremented on every advertised sample
+ *   5  temp (2)	signed, 0.01C
+ *   7  pres (3)	unsigned, 0.01hPa
+ *  10  battery (1)	0 when not measured
+ *
+ * tools/ble_receiver.py decodes it on the receiving side.
+ */
+#define BLE_ADV_VERSION 1
+#define BLE_ADV_PAYLOAD_LEN 11
+
+/*
+ * Advertise the sample for CONFIG_BLE_ADV_DURATION ms, fails when the
+ * advertising did not start.
+ */
+esp_err_t ble_adv_send(const sample_t *sample);
+
+#endif /* BLE_ADV_H */
@@ -0,0 +1,294 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "driver/i2c.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#include "bmp280_calib.h"
+#include "rtc_arena.h"
+
+
+#define BMP280_REG_CALIB 0x88
+#define BMP280_REG_CTRL_MEAS 0xf4
+#define BMP280_REG_DATA 0xf7
+
+/* osrs_t x1, osrs_p x1, forced mode */
+#define BMP280_FORCED 0x25
+/* the longest conversion of the forced x1 measurement is 6.4 ms */
+#define BMP280_CONV_MS 10
+
+#define I2C_PORT I2C_NUM_0
+#define I2C_FREQ 100000
+#define I2C_TIMEOUT_MS 100
+
+/*
+ * The ULP compares the 16 most significant bits of the 20 bit readings,
+ * as the BMP_TDIFF and BMP_PDIFF defaults suggest.
+ */
+#define RAW_SHIFT 4
+
+/* nominal raw steps per 0.01 unit when the calibration is not read */
+#define NOMINAL_T_DIFF 2.0
+#define NOMINAL_P_DIFF (10.0 / 39)
+
+
+#define CALIB_VERSION 1
+
+/* kept in the RTC arena */
+typedef struct {
+	uint16_t dig_t1;
+	int16_t dig_t2;
+	int16_t dig_t3;
+	uint16_t dig_p1;
+	int16_t dig_p2;
+	int16_t dig_p3;
+	int16_t dig_p4;
+	int16_t dig_p5;
+	int16_t dig_p6;
+	int16_t dig_p7;
+	int16_t dig_p8;
+	int16_t dig_p9;
+	int32_t adc_t;	/* operating point of the derivatives */
+	int32_t adc_p;
+	uint32_t valid;
+} calib_t;
+
+static calib_t *s_calib = NULL;
+
+
+static calib_t *calib()
+{
+	bool fresh;
+
+	if (s_calib == NULL) {
+		rtc_arena_get("calib", sizeof(*s_calib),
+		    CALIB_VERSION, (void **)&s_calib, &fresh);
+	}
+
+	return s_calib;
+}
+
+static esp_err_t reg_read(uint8_t reg, uint8_t *buf, size_t len)
+{
+	return i2c_master_write_read_device(I2C_PORT, CONFIG_BMP_ADDR, &reg, 1,
+	    buf, len, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+}
+
+static esp_err_t reg_write(uint8_t reg, uint8_t value)
+{
+	uint8_t buf[2] = { reg, value };
+
+	return i2c_master_write_to_device(I2C_PORT, CONFIG_BMP_ADDR, buf,
+	    sizeof(buf), pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+}
+
+static esp_err_t read_sensor(calib_t *c)
+{
+	uint8_t buf[24];
+	esp_err_t err;
+
+	err = reg_read(BMP280_REG_CALIB, buf, sizeof(buf));
+	if (err != ESP_OK) {
+		return err;
+	}
+
+	/* little endian coefficients in the datasheet order */
+	c->dig_t1 = buf[0] | buf[1] << 8;
+	c->dig_t2 = buf[2] | buf[3] << 8;
+	c->dig_t3 = buf[4] | buf[5] << 8;
+	c->dig_p1 = buf[6] | buf[7] << 8;
+	c->dig_p2 = buf[8] | buf[9] << 8;
+	c->dig_p3 = buf[10] | buf[11] << 8;
+	c->dig_p4 = buf[12] | buf[13] << 8;
+	c->dig_p5 = buf[14] | buf[15] << 8;
+	c->dig_p6 = buf[16] | buf[17] << 8;
+	c->dig_p7 = buf[18] | buf[19] << 8;
+	c->dig_p8 = buf[20] | buf[21] << 8;
+	c->dig_p9 = buf[22] | buf[23] << 8;
+
+	err = reg_write(BMP280_REG_CTRL_MEAS, BMP280_FORCED);
+	if (err != ESP_OK) {
+		return err;
+	}
+	vTaskDelay(pdMS_TO_TICKS(BMP280_CONV_MS));
+
+	err = reg_read(BMP280_REG_DATA, buf, 6);
+	if (err != ESP_OK) {
+		return err;
+	}
+
+	c->adc_p = buf[0] << 12 | buf[1] << 4 | buf[2] >> 4;
+	c->adc_t = buf[3] << 12 | buf[4] << 4 | buf[5] >> 4;
+
+	/* an unwired bus reads all ones */
+	if (c->dig_t1 == 0 || c->dig_t1 == 0xffff || c->dig_p1 == 0) {
+		return ESP_ERR_INVALID_RESPONSE;
+	}
+
+	return ESP_OK;
+}
+
+esp_err_t bmp280_calib_read()
+{
+	calib_t *c = calib();
+	esp_err_t err;
+	i2c_config_t config = {
+		.mode = I2C_MODE_MASTER,
+		.sda_io_num = CONFIG_BMP_SDA,
+		.scl_io_num = CONFIG_BMP_SCL,
+		.sda_pullup_en = GPIO_PULLUP_ENABLE,
+		.scl_pullup_en = GPIO_PULLUP_ENABLE,
+		.master.clk_speed = I2C_FREQ,
+	};
+
+	rtc_arena_begin(c);
+	c->valid = false;
+
+	err = i2c_param_config(I2C_PORT, &config);
+	if (err == ESP_OK) {
+		err = i2c_driver_install(I2C_PORT, I2C_MODE_MASTER, 0, 0, 0);
+	}
+	if (err == ESP_OK) {
+		err = read_sensor(c);
+		/* the ULP driver takes the pins back to the RTC IO */
+		i2c_driver_delete(I2C_PORT);
+	}
+
+	if (err == ESP_OK) {
+		c->valid = true;
+		ESP_LOGI(__func__, "dig_t1 %u, dig_p1 %u, adc_t %d, adc_p %d",
+		    c->dig_t1, c->dig_p1, c->adc_t, c->adc_p);
+	} else {
+		ESP_LOGE(__func__, "failed to read the calibration: %s",
+		    esp_err_to_name(err));
+	}
+
+	rtc_arena_commit(c);
+
+	return err;
+}
+
+/*
+ * Datasheet floating point compensation, temperature (C) and t_fine.
+ */
+static double compensate_t(const calib_t *c, int32_t adc_t, double *t_fine)
+{
+	double var1, var2;
+
+	var1 = (adc_t / 16384.0 - c->dig_t1 / 1024.0) * c->dig_t2;
+	var2 = (adc_t / 131072.0 - c->dig_t1 / 8192.0) *
+	    (adc_t / 131072.0 - c->dig_t1 / 8192.0) * c->dig_t3;
+	*t_fine = var1 + var2;
+
+	return *t_fine / 5120.0;
+}
+
+/*
+ * Datasheet floating point compensation, pressure (Pa).
+ */
+static double compensate_p(const calib_t *c, int32_t adc_p, double t_fine)
+{
+	double var1, var2, p;
+
+	var1 = t_fine / 2.0 - 64000.0;
+	var2 = var1 * var1 * c->dig_p6 / 32768.0;
+	var2 = var2 + var1 * c->dig_p5 * 2.0;
+	var2 = var2 / 4.0 + c->dig_p4 * 65536.0;
+	var1 = (c->dig_p3 * var1 * var1 / 524288.0 + c->dig_p2 * var1) /
+	    524288.0;
+	var1 = (1.0 + var1 / 32768.0) * c->dig_p1;
+	if (var1 == 0) {
+		return 0;
+	}
+	p = 1048576.0 - adc_p;
+	p = (p - var2 / 4096.0) * 6250.0 / var1;
+	var1 = c->dig_p9 * p * p / 2147483648.0;
+	var2 = p * c->dig_p8 / 32768.0;
+
+	return p + (var1 + var2 + c->dig_p7) / 16.0;
+}
+
+/*
+ * Raw threshold from the difference and the change of one compared raw step
+ * around the operating point, at least one step.
+ */
+static uint32_t to_raw(double diff, double step)
+{
+	double raw;
+
+	if (step < 0) {
+		step = -step;
+	}
+	if (step == 0) {
+		return 1;
+	}
+
+	raw = diff / step + 0.5;
+
+	return raw < 1 ? 1 : (uint32_t)raw;
+}
+
+uint32_t bmp280_calib_t_diff(uint32_t diff)
+{
+	const calib_t *c = calib();
+	double t_fine;
+	double step;
+
+	if (!c->valid) {
+		return to_raw(diff, 1 / NOMINAL_T_DIFF);
+	}
+
+	step = compensate_t(c, c->adc_t + (1 << RAW_SHIFT), &t_fine) -
+	    compensate_t(c, c->adc_t, &t_fine);
+
+	return to_raw(diff / 100.0, step);
+}
+
+uint32_t bmp280_calib_p_diff(uint32_t diff)
+{
+	const calib_t *c = calib();
+	double t_fine;
+	double step;
+
+	if (!c->valid) {
+		return to_raw(diff, 1 / NOMINAL_P_DIFF);
+	}
+
+	compensate_t(c, c->adc_t, &t_fine);
+	step = compensate_p(c, c->adc_p + (1 << RAW_SHIFT), t_fine) -
+	    compensate_p(c, c->adc_p, t_fine);
+
+	/* Pa per step, the difference is in 0.01hPa = Pa */
+	return to_raw(diff, step);
+}
@@ -0,0 +1,103 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "esp32/clk.h"
+#include "soc/rtc.h"
+#include "soc/rtc_cntl_reg.h"
+#include "soc/soc.h"
+#include "sdkconfig.h"
+
+#include "boot_time.h"
+
+
+/* the wake stub does not wait for the RTC timer longer */
+#define TIME_VALID_POLLS 1000
+
+
+/* RTC timer at the deep sleep wake, 0 when the wake stub did not run */
+static RTC_DATA_ATTR uint64_t s_wake_ticks;
+
+
+#if !CONFIG_SLEEP_PD_RTC_FAST
+/*
+ * Runs from the RTC fast memory right after the ROM on the deep sleep
+ * wake, before the bootloader. Only the registers and the RTC memory are
+ * available here.
+ */
+void RTC_IRAM_ATTR esp_wake_deep_sleep(void)
+{
+	int polls = 0;
+
+	esp_default_wake_deep_sleep();
+
+	SET_PERI_REG_MASK(RTC_CNTL_TIME_UPDATE_REG, RTC_CNTL_TIME_UPDATE);
+	while (GET_PERI_REG_MASK(RTC_CNTL_TIME_UPDATE_REG,
+	    RTC_CNTL_TIME_VALID) == 0) {
+		if (++polls == TIME_VALID_POLLS) {
+			return;
+		}
+	}
+	SET_PERI_REG_MASK(RTC_CNTL_INT_CLR_REG, RTC_CNTL_TIME_VALID_INT_CLR);
+
+	s_wake_ticks = READ_PERI_REG(RTC_CNTL_TIME0_REG) |
+	    (uint64_t)READ_PERI_REG(RTC_CNTL_TIME1_REG) << 32;
+}
+#endif
+
+void boot_time_log()
+{
+	uint64_t now = rtc_time_get();
+	uint64_t wake = s_wake_ticks;
+
+	/* a wake without the stub must not see an old stamp */
+	s_wake_ticks = 0;
+
+	switch (esp_reset_reason()) {
+		case ESP_RST_POWERON:
+			ESP_LOGI(__func__, "power up to app_main %llu us",
+			    rtc_time_slowclk_to_us(now,
+			    esp_clk_slowclk_cal_get()));
+			break;
+		case ESP_RST_DEEPSLEEP:
+			if (wake == 0 || wake > now) {
+				ESP_LOGI(__func__, "no wake stub time");
+				break;
+			}
+			ESP_LOGI(__func__, "wake stub to app_main %llu us",
+			    rtc_time_slowclk_to_us(now - wake,
+			    esp_clk_slowclk_cal_get()));
+			break;
+		default:
+			break;
+	}
+}
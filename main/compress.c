@@ -0,0 +1,98 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <float.h>
+#include <stdint.h>
+
+#include "compress.h"
+
+
+int compress_sdt(const uint32_t *t, const float *v, int n, float err,
+    bool *keep)
+{
+	int a = 0;		/* the last kept point */
+	int kept = 1;
+	float upper = FLT_MAX;	/* the doors, slopes from the point a */
+	float lower = -FLT_MAX;
+	float dt, slope;
+
+	if (n <= 0) {
+		return 0;
+	}
+
+	keep[0] = true;
+
+	for (int i = 1; i < n; i++) {
+		keep[i] = false;
+		dt = (float)(int32_t)(t[i] - t[a]);
+
+		if (dt <= 0) {
+			/* no slope to the point of the same time, keep both */
+			keep[i] = true;
+			kept++;
+			a = i;
+			upper = FLT_MAX;
+			lower = -FLT_MAX;
+			continue;
+		}
+
+		/*
+		 * The line from a to i has to pass all the points between
+		 * within err, otherwise close the segment at i - 1.
+		 */
+		slope = (v[i] - v[a]) / dt;
+		if (slope > upper || slope < lower) {
+			a = i - 1;
+			keep[a] = true;
+			kept++;
+			upper = FLT_MAX;
+			lower = -FLT_MAX;
+			dt = (float)(int32_t)(t[i] - t[a]);
+			if (dt <= 0) {
+				keep[i] = true;
+				kept++;
+				a = i;
+				continue;
+			}
+		}
+
+		if ((v[i] + err - v[a]) / dt < upper) {
+			upper = (v[i] + err - v[a]) / dt;
+		}
+		if ((v[i] - err - v[a]) / dt > lower) {
+			lower = (v[i] - err - v[a]) / dt;
+		}
+	}
+
+	if (!keep[n - 1]) {
+		keep[n - 1] = true;
+		kept++;
+	}
+
+	return kept;
+}
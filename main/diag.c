@@ -0,0 +1,137 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "driver/uart.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+#include "diag.h"
+#include "sample_buf.h"
+
+
+#define DIAG_VERSION 1
+
+#define SYNC0 0xa5
+#define SYNC1 0x5a
+
+/* sync, version, fields, samples, time */
+#define HEADER_SIZE 10
+#define CRC_SIZE 4
+
+#define UART_BUF_SIZE 256
+#define UART_TIMEOUT_MS 1000
+
+/* the samples go to the frame as they are */
+_Static_assert(sizeof(sample_t) == 8 + SAMPLE_FIELDS * 3 * sizeof(float),
+    "sample_t is not packed as the frame");
+
+
+static void put(uint8_t *buf, size_t *len, const void *data, size_t size)
+{
+	/* the ESP32 is little endian as the frame */
+	memcpy(buf + *len, data, size);
+	*len += size;
+}
+
+static esp_err_t uart_open()
+{
+	esp_err_t err;
+	uart_config_t config = {
+		.baud_rate = CONFIG_DIAG_BAUD,
+		.data_bits = UART_DATA_8_BITS,
+		.parity = UART_PARITY_DISABLE,
+		.stop_bits = UART_STOP_BITS_1,
+		.flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+	};
+
+	err = uart_driver_install(CONFIG_DIAG_UART, UART_BUF_SIZE, 0, 0, NULL,
+	    0);
+	if (err == ESP_OK) {
+		err = uart_param_config(CONFIG_DIAG_UART, &config);
+	}
+	if (err == ESP_OK) {
+		err = uart_set_pin(CONFIG_DIAG_UART, CONFIG_DIAG_TX_GPIO,
+		    UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE,
+		    UART_PIN_NO_CHANGE);
+	}
+
+	return err;
+}
+
+void diag_export(const float value[])
+{
+	int n = sample_buf_count();
+	size_t size = HEADER_SIZE + SAMPLE_FIELDS * sizeof(float) +
+	    n * sizeof(sample_t) + CRC_SIZE;
+	size_t len = 0;
+	uint8_t *frame;
+	uint8_t byte;
+	uint16_t count = n;
+	uint32_t now = time(NULL);
+	uint32_t crc;
+
+	frame = (uint8_t*)malloc(size);
+	if (frame == NULL) {
+		ESP_LOGE(__func__, "no memory for %u bytes", (unsigned)size);
+		return;
+	}
+
+	byte = SYNC0;
+	put(frame, &len, &byte, 1);
+	byte = SYNC1;
+	put(frame, &len, &byte, 1);
+	byte = DIAG_VERSION;
+	put(frame, &len, &byte, 1);
+	byte = SAMPLE_FIELDS;
+	put(frame, &len, &byte, 1);
+	put(frame, &len, &count, sizeof(count));
+	put(frame, &len, &now, sizeof(now));
+	put(frame, &len, value, SAMPLE_FIELDS * sizeof(float));
+	for (int i = 0; i < n; i++) {
+		put(frame, &len, sample_buf_get(i), sizeof(sample_t));
+	}
+
+	crc = esp_rom_crc32_le(0, frame + 2, len - 2);
+	put(frame, &len, &crc, sizeof(crc));
+
+	if (uart_open() == ESP_OK) {
+		uart_write_bytes(CONFIG_DIAG_UART, (const char *)frame, len);
+		uart_wait_tx_done(CONFIG_DIAG_UART,
+		    pdMS_TO_TICKS(UART_TIMEOUT_MS));
+	} else {
+		ESP_LOGE(__func__, "failed to open UART%d", CONFIG_DIAG_UART);
+	}
+	uart_driver_delete(CONFIG_DIAG_UART);
+
+	free(frame);
+}
@@ -0,0 +1,158 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#include "event_log.h"
+#include "rtc_arena.h"
+#include "sample_buf.h"
+
+
+#if CONFIG_EVENT_LOG
+#define LOG_VERSION 1
+
+/* one record, dumped as it is in little endian */
+typedef struct {
+	uint32_t time;
+	uint16_t id;
+	uint16_t reserved;
+	uint32_t arg[2];
+} event_t;
+
+/* ring kept in the RTC arena */
+typedef struct {
+	uint16_t head;
+	uint16_t count;
+	uint16_t pending;	/* not dumped yet */
+	uint16_t reserved;
+	event_t events[CONFIG_EVENT_LOG_SIZE];
+} event_ring_t;
+
+static event_ring_t *s_ring = NULL;
+
+_Static_assert(RTC_ARENA_COST(sizeof(event_ring_t)) +
+    SAMPLE_BUF_ARENA(CONFIG_SAMPLE_BUF_SIZE) + RTC_ARENA_SMALL <=
+    CONFIG_RTC_ARENA_SIZE, "EVENT_LOG_SIZE does not fit RTC_ARENA_SIZE");
+
+
+static event_ring_t *ring()
+{
+	bool fresh;
+
+	if (s_ring == NULL) {
+		rtc_arena_get("events", sizeof(*s_ring),
+		    LOG_VERSION, (void **)&s_ring, &fresh);
+	}
+
+	return s_ring;
+}
+
+static event_t *slot(event_ring_t *r, int i)
+{
+	return &r->events[(r->head + i) % CONFIG_EVENT_LOG_SIZE];
+}
+
+/*
+ * No formatting on the device, the oldest event is overwritten when full.
+ * The ring is not committed per event, the CRC and the undo copy cost
+ * more than formatting the event (bench event_log). event_log_dump() and
+ * rtc_arena_commit_all() before the sleep commit it, a brownout before
+ * loses the ring.
+ */
+void event_log(event_id_t id, uint32_t a, uint32_t b)
+{
+	event_ring_t *r = ring();
+	event_t *e;
+
+	if (r->count == CONFIG_EVENT_LOG_SIZE) {
+		r->head = (r->head + 1) % CONFIG_EVENT_LOG_SIZE;
+		r->count--;
+	}
+
+	e = slot(r, r->count);
+	e->time = time(NULL);
+	e->id = id;
+	e->reserved = 0;
+	e->arg[0] = a;
+	e->arg[1] = b;
+	r->count++;
+
+	if (r->pending < r->count) {
+		r->pending++;
+	}
+}
+
+void event_log_dump()
+{
+	event_ring_t *r = ring();
+	const uint8_t *p;
+
+	if (r->pending == 0) {
+		return;
+	}
+
+	printf("EVLOG:");
+	for (int i = r->count - r->pending; i < r->count; i++) {
+		p = (const uint8_t *)slot(r, i);
+		for (int j = 0; j < sizeof(event_t); j++) {
+			printf("%02x", p[j]);
+		}
+	}
+	printf("\n");
+
+	/* with the events since the last commit */
+	r->pending = 0;
+	rtc_arena_commit(r);
+}
+
+#else
+/* longest formatted event */
+#define LINE_SIZE 96
+
+static const char *s_format[EV_MAX] = {
+#define EVENT(id, format) [id] = format,
+	EVENTS
+#undef EVENT
+};
+
+void event_log(event_id_t id, uint32_t a, uint32_t b)
+{
+	char line[LINE_SIZE];
+
+	snprintf(line, sizeof(line), s_format[id], a, b);
+	ESP_LOGI(__func__, "%s", line);
+}
+
+void event_log_dump()
+{
+}
+#endif
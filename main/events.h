@@ -0,0 +1,58 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EVENTS_H
+#define EVENTS_H
+
+/*
+ * EVENT(id, format) of the binary event log, with up to two unsigned
+ * arguments. tools/event_decode.py reads the formats from this list, so
+ * only append to it and keep one event per line.
+ */
+#define EVENTS \
+	EVENT(EV_HTTP_ERROR, "HTTP_EVENT_ERROR") \
+	EVENT(EV_HTTP_CONNECTED, "HTTP_EVENT_ON_CONNECTED") \
+	EVENT(EV_HTTP_HEADER_SENT, "HTTP_EVENT_HEADER_SENT") \
+	EVENT(EV_HTTP_HEADER, "HTTP_EVENT_ON_HEADER, len=%u") \
+	EVENT(EV_HTTP_DATA, "HTTP_EVENT_ON_DATA, len=%u") \
+	EVENT(EV_HTTP_FINISH, "HTTP_EVENT_ON_FINISH") \
+	EVENT(EV_HTTP_DISCONNECTED, "HTTP_EVENT_DISCONNECTED") \
+	EVENT(EV_DELTA_TOO_LONG, "settings delta too long") \
+	EVENT(EV_POST, "Sent data (%u samples, %u bytes)") \
+	EVENT(EV_POST_STATUS, "Status = %u, content_length = %u") \
+	EVENT(EV_POST_OVERFLOW, "data buffer overflow") \
+	EVENT(EV_BUDGET_SPENT, "wake budget spent, %u samples left")
+
+typedef enum {
+#define EVENT(id, format) id,
+	EVENTS
+#undef EVENT
+	EV_MAX
+} event_id_t;
+
+#endif /* EVENTS_H */
@@ -0,0 +1,147 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <math.h>
+#include <time.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#include "fields.h"
+#include "rtc_arena.h"
+
+
+#define FIELDS_VERSION 1
+
+
+/* Kconfig has the thresholds and errors in hundredths */
+const field_desc_t field_desc[SAMPLE_FIELDS] = {
+	[SAMPLE_TEMP] = {
+		.name = "temp",
+		.cadence = CONFIG_TEMP_CADENCE,
+		.precision = CONFIG_TEMP_PRECISION,
+		.threshold = (float)CONFIG_TEMP_THRESHOLD / 100,
+		.err = (float)CONFIG_COMPRESS_TEMP_ERR / 100,
+	},
+	[SAMPLE_PRES] = {
+		.name = "pres",
+		.cadence = CONFIG_PRES_CADENCE,
+		.precision = CONFIG_PRES_PRECISION,
+		.threshold = (float)CONFIG_PRES_THRESHOLD / 100,
+		.err = (float)CONFIG_COMPRESS_PRES_ERR / 100,
+	},
+};
+
+/* the last upload of every field kept in the RTC arena */
+typedef struct {
+	uint32_t time[SAMPLE_FIELDS];
+	float value[SAMPLE_FIELDS];
+} fields_state_t;
+
+static fields_state_t *s_state = NULL;
+
+
+static fields_state_t *state()
+{
+	bool fresh;
+
+	if (s_state == NULL) {
+		rtc_arena_get("fields", sizeof(*s_state),
+		    FIELDS_VERSION, (void **)&s_state, &fresh);
+	}
+
+	return s_state;
+}
+
+uint32_t fields_due(bool *changed)
+{
+	fields_state_t *st = state();
+	uint32_t now = time(NULL);
+	uint32_t mask = 0;
+	int n = sample_buf_count();
+
+	*changed = false;
+
+	for (int f = 0; f < SAMPLE_FIELDS; f++) {
+		/* never sent yet, or the clock was set since */
+		if (st->time[f] == 0 || now < st->time[f] ||
+		    now - st->time[f] >= field_desc[f].cadence) {
+			mask |= 1 << f;
+			continue;
+		}
+
+		if (field_desc[f].threshold <= 0) {
+			continue;
+		}
+
+		for (int i = 0; i < n; i++) {
+			if (fabsf(sample_buf_get(i)->field[f].mean -
+			    st->value[f]) >= field_desc[f].threshold) {
+				mask |= 1 << f;
+				*changed = true;
+				break;
+			}
+		}
+	}
+
+	return mask;
+}
+
+bool fields_alert(const float value[SAMPLE_FIELDS])
+{
+	fields_state_t *st = state();
+
+	for (int f = 0; f < SAMPLE_FIELDS; f++) {
+		if (st->time[f] != 0 && field_desc[f].threshold > 0 &&
+		    fabsf(value[f] - st->value[f]) >= field_desc[f].threshold) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void fields_sent(uint32_t mask)
+{
+	fields_state_t *st = state();
+	int n = sample_buf_count();
+
+	if (n == 0) {
+		return;
+	}
+
+	rtc_arena_begin(st);
+
+	for (int f = 0; f < SAMPLE_FIELDS; f++) {
+		if (mask & (1 << f)) {
+			st->time[f] = time(NULL);
+			st->value[f] = sample_buf_get(n - 1)->field[f].mean;
+		}
+	}
+
+	rtc_arena_commit(st);
+}
@@ -0,0 +1,67 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FIELDS_H
+#define FIELDS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sample_buf.h"
+
+/*
+ * Upload profile of one field.
+ */
+typedef struct {
+	const char *name;	/* influxdb field key */
+	uint32_t cadence;	/* s, upload at most this often, 0 always */
+	int precision;		/* decimal places */
+	float threshold;	/* change uploaded regardless the cadence */
+	float err;		/* compression error bound */
+} field_desc_t;
+
+extern const field_desc_t field_desc[SAMPLE_FIELDS];
+
+/*
+ * Mask of the fields due for the upload, by the cadence or by a buffered
+ * value moved over the threshold (*changed set) since the last upload.
+ */
+uint32_t fields_due(bool *changed);
+
+/*
+ * Whether a new reading moved over the threshold of any field since its
+ * last upload.
+ */
+bool fields_alert(const float value[SAMPLE_FIELDS]);
+
+/*
+ * Record the upload of the fields in the mask.
+ */
+void fields_sent(uint32_t mask);
+
+#endif /* FIELDS_H */
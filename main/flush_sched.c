@@ -0,0 +1,211 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <time.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#include "fields.h"
+#include "flush_sched.h"
+#include "rtc_arena.h"
+#include "sample_buf.h"
+#include "settings.h"
+#include "wake_sched.h"
+
+
+#define LINK_VERSION 2
+
+/* weight of the newest attempt in the averages is 1/2^AVG_SHIFT */
+#define AVG_SHIFT 2
+
+/* retries are averaged in 1/16 */
+#define RETRY_SCALE 16
+
+/* failed attempt counts as all the retries used */
+#define RETRY_FAIL (CONFIG_MAXIMUM_RETRY + 1)
+
+/* first retry (s) of a stale batch that was not sent */
+#define STALE_RETRY_MIN 60
+
+
+/* recent link conditions kept in the RTC arena */
+typedef struct {
+	int16_t rssi;		/* dBm */
+	uint16_t retries;	/* 1/RETRY_SCALE */
+	uint32_t connect_ms;
+	uint32_t attempts;
+	uint32_t stale_retry;	/* s, 0 while the batch is not stale */
+} link_stats_t;
+
+static link_stats_t *s_link = NULL;
+
+
+static link_stats_t *link()
+{
+	bool fresh;
+
+	if (s_link == NULL) {
+		rtc_arena_get("link", sizeof(*s_link),
+		    LINK_VERSION, (void **)&s_link, &fresh);
+	}
+
+	return s_link;
+}
+
+static int32_t avg(int32_t old, int32_t new)
+{
+	return old - (old >> AVG_SHIFT) + (new >> AVG_SHIFT);
+}
+
+void flush_sched_record(bool connected, int8_t rssi, int retries,
+    uint32_t connect_ms)
+{
+	link_stats_t *l = link();
+
+	rtc_arena_begin(l);
+
+	if (!connected) {
+		retries = RETRY_FAIL;
+	}
+
+	if (l->attempts == 0) {
+		l->rssi = connected ? rssi : CONFIG_LINK_RSSI_WEAK;
+		l->retries = retries * RETRY_SCALE;
+		l->connect_ms = connect_ms;
+	} else {
+		if (connected) {
+			l->rssi = avg(l->rssi, rssi);
+		}
+		l->retries = avg(l->retries, retries * RETRY_SCALE);
+		l->connect_ms = avg(l->connect_ms, connect_ms);
+	}
+	l->attempts++;
+
+	rtc_arena_commit(l);
+}
+
+uint32_t flush_sched_cost()
+{
+	link_stats_t *l = link();
+	uint32_t cost;
+
+	cost = l->connect_ms +
+	    l->retries * CONFIG_LINK_RETRY_MS / RETRY_SCALE;
+
+	/* lower rates and retransmissions make the upload longer too */
+	if (l->rssi < CONFIG_LINK_RSSI_WEAK) {
+		cost *= 2;
+	}
+
+	return cost;
+}
+
+bool flush_sched_due(bool deadline)
+{
+	int count = sample_buf_count();
+	uint32_t cost;
+	int64_t age;
+	bool changed;
+
+	if (count == 0) {
+		return deadline;
+	}
+
+	if (count == CONFIG_SAMPLE_BUF_SIZE || deadline) {
+		return true;
+	}
+
+	/* nothing worth the connect yet, a field change goes right away */
+	if (fields_due(&changed) == 0) {
+		return false;
+	}
+	if (changed) {
+		ESP_LOGI(__func__, "field changed over the threshold");
+		return true;
+	}
+
+	if (count < settings_get()->batch) {
+		return false;
+	}
+
+	/* the connect cost is shared by all the buffered samples */
+	cost = flush_sched_cost();
+	if (cost / count <= CONFIG_LINK_SAMPLE_COST_MS) {
+		return true;
+	}
+
+	age = (int64_t)time(NULL) - sample_buf_get(0)->time;
+	if (age >= settings_get()->flush_stale) {
+		return true;
+	}
+
+	ESP_LOGI(__func__, "link cost %u ms for %d samples, flush deferred",
+	    cost, count);
+
+	return false;
+}
+
+void flush_sched_arm()
+{
+	link_stats_t *l = link();
+	uint32_t now = time(NULL);
+	uint32_t deadline = 0;
+
+	if (sample_buf_count() > 0) {
+		deadline = sample_buf_get(0)->time + settings_get()->flush_stale;
+	}
+
+	rtc_arena_begin(l);
+	if (deadline == 0 || deadline > now) {
+		l->stale_retry = 0;
+	} else if (wake_sched_get(WAKE_FLUSH) > now) {
+		/* a wake before the retry, keep it */
+		deadline = wake_sched_get(WAKE_FLUSH);
+	} else {
+		/*
+		 * The stale batch was not sent whole, the link is down or the
+		 * budget ran out. Back off up to the heartbeat period instead
+		 * of waking right away again.
+		 */
+		l->stale_retry = l->stale_retry == 0 ? STALE_RETRY_MIN :
+		    l->stale_retry * 2;
+		if (l->stale_retry > settings_get()->safe_timer) {
+			l->stale_retry = settings_get()->safe_timer;
+		}
+		deadline = now + l->stale_retry;
+		/* the heartbeat comes first, it retries anyway */
+		if (wake_sched_get(WAKE_HEARTBEAT) != 0 &&
+		    deadline >= wake_sched_get(WAKE_HEARTBEAT)) {
+			deadline = 0;
+		}
+	}
+
+	rtc_arena_commit(l);
+	wake_sched_set(WAKE_FLUSH, deadline);
+}
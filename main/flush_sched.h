@@ -0,0 +1,61 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FLUSH_SCHED_H
+#define FLUSH_SCHED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Record the outcome of a connection attempt, connect_ms is the time from
+ * the WIFI start to the address or to the failure.
+ */
+void flush_sched_record(bool connected, int8_t rssi, int retries,
+    uint32_t connect_ms);
+
+/*
+ * Expected time (ms) to connect with the current link conditions.
+ */
+uint32_t flush_sched_cost(void);
+
+/*
+ * Decide whether the buffered samples should be sent now, always when a
+ * wake_sched deadline passed. Flushing is deferred while the link is
+ * expensive, up to the staleness limit.
+ */
+bool flush_sched_due(bool deadline);
+
+/*
+ * Set the WAKE_FLUSH deadline before the sleep, when the oldest buffered
+ * sample gets stale. A stale batch left after the flush is retried with a
+ * growing backoff, up to the heartbeat period.
+ */
+void flush_sched_arm(void);
+
+#endif /* FLUSH_SCHED_H */
@@ -0,0 +1,148 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_http_server.h"
+#include "sdkconfig.h"
+
+#include "metrics.h"
+#include "sleep_mode.h"
+
+
+#define METRICS_LABELS "{site=\"" CONFIG_INFLUX_SITE "\",place=\"" \
+    CONFIG_INFLUX_PLACE "\"}"
+
+#define METRICS_SIZE 512
+
+
+static httpd_handle_t s_server = NULL;
+static SemaphoreHandle_t s_lock = NULL;
+static char s_body[METRICS_SIZE];
+static int s_len = 0;
+
+
+/*
+ * Serve the preformatted response, no formatting on the request path.
+ */
+static esp_err_t metrics_get_handler(httpd_req_t *req)
+{
+	esp_err_t ret;
+
+	httpd_resp_set_type(req, "text/plain; version=0.0.4");
+
+	xSemaphoreTake(s_lock, portMAX_DELAY);
+	ret = httpd_resp_send(req, s_body, s_len);
+	xSemaphoreGive(s_lock);
+
+	return ret;
+}
+
+void metrics_start()
+{
+	httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+	httpd_uri_t uri = {
+		.uri = "/metrics",
+		.method = HTTP_GET,
+		.handler = metrics_get_handler,
+		.user_ctx = NULL
+	};
+
+	if (s_server != NULL) {
+		return;
+	}
+
+	if (s_lock == NULL) {
+		s_lock = xSemaphoreCreateMutex();
+	}
+
+	config.server_port = CONFIG_METRICS_PORT;
+
+	if (httpd_start(&s_server, &config) != ESP_OK) {
+		ESP_LOGE(__func__, "failed to start the metrics server");
+		s_server = NULL;
+		return;
+	}
+
+	httpd_register_uri_handler(s_server, &uri);
+}
+
+void metrics_stop()
+{
+	if (s_server != NULL) {
+		httpd_stop(s_server);
+		s_server = NULL;
+	}
+}
+
+int metrics_format(char *buf, size_t size, float temp, float pres,
+    uint32_t interval_ms, uint32_t free_heap)
+{
+	int len;
+
+	/* the base units, hPa to Pa */
+	len = snprintf(buf, size,
+	    "# TYPE temp_sensor_temperature_celsius gauge\n"
+	    "temp_sensor_temperature_celsius" METRICS_LABELS " %0.2f\n"
+	    "# TYPE temp_sensor_pressure_pascals gauge\n"
+	    "temp_sensor_pressure_pascals" METRICS_LABELS " %0.0f\n"
+	    "# TYPE temp_sensor_wake_interval_seconds gauge\n"
+	    "temp_sensor_wake_interval_seconds" METRICS_LABELS " %u.%03u\n"
+	    "# TYPE temp_sensor_free_heap_bytes gauge\n"
+	    "temp_sensor_free_heap_bytes" METRICS_LABELS " %u\n",
+	    temp, pres * 100,
+	    interval_ms / 1000, interval_ms % 1000,
+	    free_heap);
+
+	return (len < 0 || len >= size) ? -1 : len;
+}
+
+void metrics_update(float temp, float pres)
+{
+	int len;
+	char body[METRICS_SIZE];
+
+	len = metrics_format(body, METRICS_SIZE, temp, pres,
+	    sleep_mode_interval(), esp_get_free_heap_size());
+	if (len < 0) {
+		return;
+	}
+
+	if (s_lock == NULL) {
+		s_lock = xSemaphoreCreateMutex();
+	}
+
+	xSemaphoreTake(s_lock, portMAX_DELAY);
+	memcpy(s_body, body, len);
+	s_len = len;
+	xSemaphoreGive(s_lock);
+}
@@ -0,0 +1,369 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "sdkconfig.h"
+
+#include "rtc_arena.h"
+
+
+#define ARENA_MAGIC 0x41525443
+
+/*
+ * Version of the arena header layout. Any change of the structures below
+ * must increase it, so the whole arena is reinitialized after the update.
+ */
+#define ARENA_VERSION 2
+
+#define ARENA_REGIONS 12
+
+/*
+ * The commit steps reach the RTC memory in this order, a brownout can stop
+ * the CPU between any two of them. The host build cuts the power there.
+ */
+#ifndef RTC_ARENA_BARRIER
+#define RTC_ARENA_BARRIER() __sync_synchronize()
+#endif
+
+
+typedef struct {
+	char name[RTC_ARENA_NAME_LEN];
+	uint16_t version;
+	uint16_t size;
+	uint16_t offset;
+	uint16_t reserved;
+} arena_region_t;
+
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t count;
+	uint32_t used;
+	arena_region_t regions[ARENA_REGIONS];
+	uint32_t crc;
+} arena_header_t;
+
+/* the content of one region before its modification, rtc_arena_begin() */
+typedef struct {
+	uint16_t owner;		/* region index + 1, 0 none */
+	uint16_t size;
+	uint32_t crc;		/* the committed one of the region */
+	uint32_t data[(CONFIG_RTC_ARENA_UNDO + 3) / 4];
+} arena_undo_t;
+
+/* regions are word aligned */
+#define ALIGN(x) RTC_ARENA_COST(x)
+
+
+/*
+ * Not initialized on any reset, the content is validated by the CRCs. The
+ * header changes only when a region is allocated, the copy is the last
+ * committed one. The region CRCs change on every commit, they are kept
+ * apart from the header.
+ */
+RTC_NOINIT_ATTR static arena_header_t s_header;
+RTC_NOINIT_ATTR static arena_header_t s_header_copy;
+RTC_NOINIT_ATTR static uint32_t s_crc[ARENA_REGIONS];
+RTC_NOINIT_ATTR static arena_undo_t s_undo;
+RTC_NOINIT_ATTR static uint32_t s_data[CONFIG_RTC_ARENA_SIZE / 4];
+
+static bool s_checked = false;
+
+
+static uint32_t crc(const void *buf, size_t len)
+{
+	return esp_rom_crc32_le(0, buf, len);
+}
+
+static bool header_valid(const arena_header_t *h)
+{
+	return h->magic == ARENA_MAGIC &&
+	    h->version == ARENA_VERSION &&
+	    h->count <= ARENA_REGIONS &&
+	    h->used <= sizeof(s_data) &&
+	    h->crc == crc(h, offsetof(arena_header_t, crc));
+}
+
+static void header_commit()
+{
+	s_header.crc = crc(&s_header, offsetof(arena_header_t, crc));
+	RTC_ARENA_BARRIER();
+	s_header_copy = s_header;
+	RTC_ARENA_BARRIER();
+}
+
+static uint8_t *region_data(const arena_region_t *r)
+{
+	return (uint8_t *)s_data + r->offset;
+}
+
+static int region_index(const arena_region_t *r)
+{
+	return r - s_header.regions;
+}
+
+static bool region_valid(const arena_region_t *r)
+{
+	return s_crc[region_index(r)] == crc(region_data(r), r->size);
+}
+
+static void region_commit(arena_region_t *r)
+{
+	s_crc[region_index(r)] = crc(region_data(r), r->size);
+	RTC_ARENA_BARRIER();
+}
+
+/*
+ * Roll back the region a brownout cut in the middle of its modification.
+ * A cut here leaves the undo in place, the next boot does it again.
+ */
+static void undo_recover()
+{
+	arena_region_t *r;
+
+	if (s_undo.owner == 0) {
+		return;
+	}
+
+	if (s_undo.owner <= s_header.count) {
+		r = &s_header.regions[s_undo.owner - 1];
+		if (!region_valid(r) && s_undo.size == r->size &&
+		    s_undo.crc == crc(s_undo.data, s_undo.size)) {
+			ESP_LOGI(__func__, "region %s rolled back", r->name);
+			memcpy(region_data(r), s_undo.data, r->size);
+			region_commit(r);
+		}
+	}
+
+	s_undo.owner = 0;
+	RTC_ARENA_BARRIER();
+}
+
+/*
+ * Validate the arena header once per boot, reinitialize it on power on,
+ * corruption or arena layout change. The header of a cut allocation is
+ * restored from its copy.
+ */
+static void arena_check()
+{
+	if (s_checked) {
+		return;
+	}
+	s_checked = true;
+
+	if (esp_reset_reason() != ESP_RST_POWERON) {
+		if (!header_valid(&s_header) && header_valid(&s_header_copy)) {
+			ESP_LOGI(__func__, "RTC arena header restored");
+			s_header = s_header_copy;
+			RTC_ARENA_BARRIER();
+		}
+		if (header_valid(&s_header)) {
+			/* the copy of a header commit cut before it */
+			if (memcmp(&s_header_copy, &s_header,
+			    sizeof(s_header)) != 0) {
+				s_header_copy = s_header;
+				RTC_ARENA_BARRIER();
+			}
+			undo_recover();
+			return;
+		}
+	}
+
+	ESP_LOGI(__func__, "RTC arena reinitialized");
+
+	s_undo.owner = 0;
+	memset(&s_header, 0, sizeof(s_header));
+	s_header.magic = ARENA_MAGIC;
+	s_header.version = ARENA_VERSION;
+	header_commit();
+}
+
+static arena_region_t *region_find(const char *name)
+{
+	for (int i = 0; i < s_header.count; i++) {
+		if (strncmp(s_header.regions[i].name, name,
+		    RTC_ARENA_NAME_LEN) == 0) {
+			return &s_header.regions[i];
+		}
+	}
+
+	return NULL;
+}
+
+static arena_region_t *region_from_data(const void *region)
+{
+	for (int i = 0; i < s_header.count; i++) {
+		if (region_data(&s_header.regions[i]) == region) {
+			return &s_header.regions[i];
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Zeroed RAM kept for this boot only, the module keeps working without the
+ * persistence when the arena is exhausted.
+ */
+static esp_err_t region_fallback(const char *name, size_t size,
+    void **region, bool *fresh)
+{
+	ESP_LOGE(__func__, "no space for %s (%u bytes), not kept over the sleep",
+	    name, (unsigned)size);
+
+	*region = calloc(1, size);
+	if (*region == NULL) {
+		abort();
+	}
+	*fresh = true;
+
+	return ESP_ERR_NO_MEM;
+}
+
+esp_err_t rtc_arena_get(const char *name, size_t size, uint16_t version,
+    void **region, bool *fresh)
+{
+	arena_region_t *r;
+	uint32_t offset;
+
+	arena_check();
+
+	r = region_find(name);
+
+	if (r != NULL && r->size == size && r->version == version &&
+	    region_valid(r)) {
+		*region = region_data(r);
+		*fresh = false;
+		return ESP_OK;
+	}
+
+	if (r == NULL && s_header.count == ARENA_REGIONS) {
+		return region_fallback(name, size, region, fresh);
+	}
+
+	offset = (r != NULL) ? r->offset : s_header.used;
+
+	/* the layout changed, only the last region can grow in place */
+	if (r != NULL && size > r->size &&
+	    r->offset + ALIGN(r->size) != s_header.used) {
+		offset = s_header.used;
+	}
+
+	if (offset + ALIGN(size) > sizeof(s_data)) {
+		return region_fallback(name, size, region, fresh);
+	}
+
+	if (r == NULL) {
+		r = &s_header.regions[s_header.count++];
+		strlcpy(r->name, name, RTC_ARENA_NAME_LEN);
+	}
+	if (s_undo.owner == region_index(r) + 1) {
+		s_undo.owner = 0;
+	}
+	r->offset = offset;
+
+	if (r->offset + ALIGN(size) > s_header.used) {
+		s_header.used = r->offset + ALIGN(size);
+	}
+
+	ESP_LOGI(__func__, "region %s initialized", name);
+
+	r->size = size;
+	r->version = version;
+	memset(region_data(r), 0, size);
+	/* fresh again after a cut before the module commits its content */
+	s_crc[region_index(r)] = ~crc(region_data(r), size);
+	header_commit();
+
+	*region = region_data(r);
+	*fresh = true;
+
+	return ESP_OK;
+}
+
+void rtc_arena_begin(const void *region)
+{
+	arena_region_t *r = region_from_data(region);
+
+	if (r == NULL || s_undo.owner == region_index(r) + 1) {
+		return;
+	}
+
+	/* one region at a time, the other one is done */
+	if (s_undo.owner != 0) {
+		rtc_arena_commit(
+		    region_data(&s_header.regions[s_undo.owner - 1]));
+	}
+
+	if (r->size > sizeof(s_undo.data)) {
+		return;
+	}
+
+	memcpy(s_undo.data, region_data(r), r->size);
+	s_undo.size = r->size;
+	s_undo.crc = s_crc[region_index(r)];
+	RTC_ARENA_BARRIER();
+	s_undo.owner = region_index(r) + 1;
+	RTC_ARENA_BARRIER();
+}
+
+void rtc_arena_commit(const void *region)
+{
+	arena_region_t *r = region_from_data(region);
+
+	if (r == NULL) {
+		return;
+	}
+
+	/* the modification reached the RTC memory before its CRC */
+	RTC_ARENA_BARRIER();
+	region_commit(r);
+
+	if (s_undo.owner == region_index(r) + 1) {
+		s_undo.owner = 0;
+		RTC_ARENA_BARRIER();
+	}
+}
+
+void rtc_arena_commit_all()
+{
+	RTC_ARENA_BARRIER();
+	for (int i = 0; i < s_header.count; i++) {
+		region_commit(&s_header.regions[i]);
+	}
+
+	if (s_undo.owner != 0) {
+		s_undo.owner = 0;
+		RTC_ARENA_BARRIER();
+	}
+}
@@ -0,0 +1,82 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RTC_ARENA_H
+#define RTC_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/* maximal length of the region name including the terminating zero */
+#define RTC_ARENA_NAME_LEN 12
+
+/* arena bytes taken by a region of the size */
+#define RTC_ARENA_COST(size) (((size) + 3) & ~3)
+
+/*
+ * Upper bound of all the small regions together (settings, counters,
+ * deadlines), the large ones check they fit the rest at build time.
+ */
+#define RTC_ARENA_SMALL 384
+
+/*
+ * Get the named region of the RTC arena.
+ *
+ * The region keeps its content over the deep sleep. It is zeroed and
+ * *fresh is set when it was not allocated yet, its size or version differ
+ * from the stored ones (firmware update) or its CRC does not match
+ * (corruption). It stays fresh until its first rtc_arena_commit().
+ *
+ * Returns ESP_ERR_NO_MEM when the arena is exhausted, *region then points to
+ * a zeroed RAM kept for this boot only and *fresh is set.
+ */
+esp_err_t rtc_arena_get(const char *name, size_t size, uint16_t version,
+    void **region, bool *fresh);
+
+/*
+ * Save the region before modifying it. A brownout until the following
+ * rtc_arena_commit() rolls the region back to this content on the next
+ * boot instead of losing it to the CRC mismatch. One region is protected
+ * at a time, beginning another one commits the previous one. A region over
+ * RTC_ARENA_UNDO is not protected.
+ */
+void rtc_arena_begin(const void *region);
+
+/*
+ * Recompute the CRC of the region after it was modified.
+ */
+void rtc_arena_commit(const void *region);
+
+/*
+ * Recompute the CRC of all the regions, call before the deep sleep.
+ */
+void rtc_arena_commit_all(void);
+
+#endif /* RTC_ARENA_H */
@@ -0,0 +1,222 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#include "rtc_arena.h"
+#include "sample_buf.h"
+
+
+#define BUF_VERSION 3
+
+/* ring buffer kept in the RTC arena */
+typedef struct {
+	uint16_t head;
+	uint16_t count;
+	sample_t samples[CONFIG_SAMPLE_BUF_SIZE];
+} sample_ring_t;
+
+static sample_ring_t *s_ring = NULL;
+
+_Static_assert(sizeof(sample_ring_t) == 4 +
+    CONFIG_SAMPLE_BUF_SIZE * sizeof(sample_t), "SAMPLE_BUF_ARENA is stale");
+_Static_assert(SAMPLE_BUF_ARENA(CONFIG_SAMPLE_BUF_SIZE) + RTC_ARENA_SMALL <=
+    CONFIG_RTC_ARENA_SIZE, "SAMPLE_BUF_SIZE does not fit RTC_ARENA_SIZE");
+_Static_assert(CONFIG_RTC_ARENA_UNDO == 0 ||
+    sizeof(sample_ring_t) <= CONFIG_RTC_ARENA_UNDO,
+    "SAMPLE_BUF_SIZE does not fit RTC_ARENA_UNDO");
+
+
+static sample_ring_t *ring()
+{
+	bool fresh;
+
+	if (s_ring == NULL) {
+		rtc_arena_get("samples", sizeof(*s_ring),
+		    BUF_VERSION, (void **)&s_ring, &fresh);
+	}
+
+	return s_ring;
+}
+
+static sample_t *slot(sample_ring_t *r, int i)
+{
+	return &r->samples[(r->head + i) % CONFIG_SAMPLE_BUF_SIZE];
+}
+
+/*
+ * Remove the i-th sample by moving the newer ones down.
+ */
+static void close_gap(sample_ring_t *r, int i)
+{
+	for (int j = i; j < r->count - 1; j++) {
+		*slot(r, j) = *slot(r, j + 1);
+	}
+	r->count--;
+}
+
+/*
+ * Merge the bucket i + 1 into i and close the gap.
+ */
+static void merge(sample_ring_t *r, int i)
+{
+	sample_t *a = slot(r, i);
+	sample_t *b = slot(r, i + 1);
+	uint32_t count = a->count + b->count;
+
+	a->time = ((uint64_t)a->time * a->count +
+	    (uint64_t)b->time * b->count) / count;
+
+	for (int f = 0; f < SAMPLE_FIELDS; f++) {
+		a->field[f].mean = (a->field[f].mean * a->count +
+		    b->field[f].mean * b->count) / count;
+		if (b->field[f].min < a->field[f].min) {
+			a->field[f].min = b->field[f].min;
+		}
+		if (b->field[f].max > a->field[f].max) {
+			a->field[f].max = b->field[f].max;
+		}
+	}
+
+	a->count = count > UINT16_MAX ? UINT16_MAX : count;
+	a->flags |= b->flags;
+
+	close_gap(r, i + 1);
+}
+
+/*
+ * Pick the oldest adjacent pair of the smallest equal count, the buckets
+ * then grow as powers of two towards the oldest data.
+ */
+static int merge_pick(sample_ring_t *r)
+{
+	int pick = 0;
+	uint32_t best = UINT32_MAX;
+
+	for (int i = 0; i < r->count - 1; i++) {
+		if (slot(r, i)->count == slot(r, i + 1)->count &&
+		    slot(r, i)->count < best) {
+			best = slot(r, i)->count;
+			pick = i;
+		}
+	}
+
+	return pick;
+}
+
+void sample_buf_push(uint32_t time, const float value[SAMPLE_FIELDS],
+    uint16_t flags)
+{
+	sample_ring_t *r = ring();
+	sample_t *sample;
+
+	rtc_arena_begin(r);
+
+	if (r->count == CONFIG_SAMPLE_BUF_SIZE) {
+		if (r->count > 1) {
+			merge(r, merge_pick(r));
+		} else {
+			r->head = (r->head + 1) % CONFIG_SAMPLE_BUF_SIZE;
+			r->count--;
+		}
+	}
+
+	sample = slot(r, r->count);
+	sample->time = time;
+	sample->count = 1;
+	sample->flags = flags;
+	for (int f = 0; f < SAMPLE_FIELDS; f++) {
+		sample->field[f].mean = value[f];
+		sample->field[f].min = value[f];
+		sample->field[f].max = value[f];
+	}
+	r->count++;
+
+	rtc_arena_commit(r);
+}
+
+int sample_buf_count()
+{
+	return ring()->count;
+}
+
+const sample_t *sample_buf_get(int i)
+{
+	sample_ring_t *r = ring();
+
+	if (i < 0 || i >= r->count) {
+		return NULL;
+	}
+
+	return slot(r, i);
+}
+
+void sample_buf_drop(int n)
+{
+	sample_ring_t *r = ring();
+
+	rtc_arena_begin(r);
+
+	if (n > r->count) {
+		n = r->count;
+	}
+
+	r->head = (r->head + n) % CONFIG_SAMPLE_BUF_SIZE;
+	r->count -= n;
+
+	rtc_arena_commit(r);
+}
+
+void sample_buf_remove(int i)
+{
+	sample_ring_t *r = ring();
+
+	if (i < 0 || i >= r->count) {
+		return;
+	}
+
+	rtc_arena_begin(r);
+	close_gap(r, i);
+
+	rtc_arena_commit(r);
+}
+
+void sample_buf_shift_time(int32_t delta)
+{
+	sample_ring_t *r = ring();
+
+	rtc_arena_begin(r);
+
+	for (int i = 0; i < r->count; i++) {
+		slot(r, i)->time += delta;
+	}
+
+	rtc_arena_commit(r);
+}
@@ -0,0 +1,97 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SAMPLE_BUF_H
+#define SAMPLE_BUF_H
+
+#include <stdint.h>
+
+#include "rtc_arena.h"
+
+typedef enum {
+	SAMPLE_TEMP,
+	SAMPLE_PRES,
+	SAMPLE_FIELDS
+} sample_field_id_t;
+
+typedef struct {
+	float mean;
+	float min;
+	float max;
+} sample_field_t;
+
+/*
+ * A raw sample or a bucket of the merged adjacent samples.
+ */
+typedef struct {
+	uint32_t time;		/* unix time (s), mean of the merged */
+	uint16_t count;		/* raw samples merged, 1 for a raw one */
+	uint16_t flags;		/* SAMPLE_ALERT, ored when merged */
+	sample_field_t field[SAMPLE_FIELDS];
+} sample_t;
+
+/* a field moved over its threshold, uploaded ahead of the history */
+#define SAMPLE_ALERT (1 << 0)
+
+/* RTC arena bytes taken by the buffer of n samples */
+#define SAMPLE_BUF_ARENA(n) RTC_ARENA_COST(4 + (n) * sizeof(sample_t))
+
+/*
+ * Append a raw sample. When the buffer is full the oldest adjacent buckets
+ * of the same and smallest count are merged, so the buffer covers the
+ * whole outage with decreasing resolution of the older data.
+ */
+void sample_buf_push(uint32_t time, const float value[SAMPLE_FIELDS],
+    uint16_t flags);
+
+/*
+ * Number of the buffered samples.
+ */
+int sample_buf_count(void);
+
+/*
+ * Get the i-th buffered sample, 0 is the oldest.
+ */
+const sample_t *sample_buf_get(int i);
+
+/*
+ * Drop n oldest samples.
+ */
+void sample_buf_drop(int n);
+
+/*
+ * Remove the i-th sample, 0 is the oldest.
+ */
+void sample_buf_remove(int i);
+
+/*
+ * Move the time of all the samples, used when the clock was set.
+ */
+void sample_buf_shift_time(int32_t delta);
+
+#endif /* SAMPLE_BUF_H */
@@ -0,0 +1,232 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+
+#include "rtc_arena.h"
+#include "settings.h"
+
+
+/*
+ * Version of settings_t, stored with the NVS blob. Any change of the
+ * fields or their units must increase it.
+ */
+#define SETTINGS_VERSION 2
+
+#define NVS_NAMESPACE "temp_sensor"
+#define NVS_KEY "settings"
+
+#define DELTA_SIZE 128
+
+
+typedef struct {
+	const char *key;
+	size_t offset;
+	uint32_t min;
+	uint32_t max;
+	bool ulp;	/* parameter of the ULP program */
+	int clears;	/* offset of the field it overrides, -1 none */
+} settings_key_t;
+
+/* the NVS blob, the settings in the units of its version */
+typedef struct {
+	uint32_t version;
+	settings_t settings;
+} settings_blob_t;
+
+static const settings_key_t s_keys[] = {
+	{ "tdiff", offsetof(settings_t, t_diff), 1, 0xffff, true,
+	    offsetof(settings_t, t_diff_c) },
+	{ "pdiff", offsetof(settings_t, p_diff), 1, 0xffff, true,
+	    offsetof(settings_t, p_diff_pa) },
+	{ "period", offsetof(settings_t, period), 1, 3600, true, -1 },
+	{ "batch", offsetof(settings_t, batch), 1, CONFIG_SAMPLE_BUF_SIZE,
+	    false, -1 },
+	{ "timer", offsetof(settings_t, safe_timer), 60, 86400, false, -1 },
+	{ "stale", offsetof(settings_t, flush_stale), 0, 86400, false, -1 },
+	{ "tdiff_c", offsetof(settings_t, t_diff_c), 1, 10000, true, -1 },
+	{ "pdiff_pa", offsetof(settings_t, p_diff_pa), 1, 10000, true, -1 },
+};
+
+static settings_t *s_settings = NULL;
+
+
+static uint32_t *field(settings_t *settings, size_t offset)
+{
+	return (uint32_t *)((uint8_t *)settings + offset);
+}
+
+static void settings_default(settings_t *settings)
+{
+	settings->t_diff = CONFIG_BMP_TDIFF;
+	settings->p_diff = CONFIG_BMP_PDIFF;
+	settings->period = CONFIG_BMP_PERIOD;
+	settings->batch = CONFIG_BATCH_SIZE;
+	settings->safe_timer = CONFIG_SAFE_TIMER;
+	settings->flush_stale = CONFIG_FLUSH_STALE;
+#if CONFIG_BMP_CALIB
+	settings->t_diff_c = CONFIG_BMP_CALIB_TDIFF;
+	settings->p_diff_pa = CONFIG_BMP_CALIB_PDIFF;
+#else
+	settings->t_diff_c = 0;
+	settings->p_diff_pa = 0;
+#endif
+}
+
+/*
+ * Settings received before survive the power loss in NVS.
+ */
+static void settings_load(settings_t *settings)
+{
+	nvs_handle_t nvs;
+	settings_blob_t blob;
+	size_t len = sizeof(blob);
+
+	settings_default(settings);
+
+	if (nvs_flash_init() != ESP_OK ||
+	    nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+		return;
+	}
+
+	/* the units of another version are not converted, back to defaults */
+	if (nvs_get_blob(nvs, NVS_KEY, &blob, &len) == ESP_OK) {
+		if (len == sizeof(blob) && blob.version == SETTINGS_VERSION) {
+			*settings = blob.settings;
+		} else {
+			ESP_LOGW(__func__, "stored settings of another version");
+		}
+	}
+
+	nvs_close(nvs);
+}
+
+static void settings_store(const settings_t *settings)
+{
+	nvs_handle_t nvs;
+	settings_blob_t blob = {
+		.version = SETTINGS_VERSION,
+		.settings = *settings,
+	};
+
+	if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+		ESP_LOGE(__func__, "failed to store the settings");
+		return;
+	}
+
+	if (nvs_set_blob(nvs, NVS_KEY, &blob, sizeof(blob)) == ESP_OK) {
+		nvs_commit(nvs);
+	}
+
+	nvs_close(nvs);
+}
+
+const settings_t *settings_get()
+{
+	bool fresh;
+
+	if (s_settings == NULL) {
+		rtc_arena_get("settings", sizeof(*s_settings),
+		    SETTINGS_VERSION, (void **)&s_settings, &fresh);
+		if (fresh) {
+			settings_load(s_settings);
+			rtc_arena_commit(s_settings);
+		}
+	}
+
+	return s_settings;
+}
+
+esp_err_t settings_apply_delta(const char *delta, bool *ulp_changed)
+{
+	settings_t new = *settings_get();
+	char buf[DELTA_SIZE];
+	char *item, *value, *end, *save;
+	unsigned long v;
+
+	*ulp_changed = false;
+
+	if (strlcpy(buf, delta, DELTA_SIZE) >= DELTA_SIZE) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	for (item = strtok_r(buf, ",", &save); item != NULL;
+	    item = strtok_r(NULL, ",", &save)) {
+		value = strchr(item, '=');
+		if (value == NULL) {
+			return ESP_ERR_INVALID_ARG;
+		}
+		*value++ = '\0';
+
+		while (*item == ' ') {
+			item++;
+		}
+
+		for (int i = 0; i < sizeof(s_keys) / sizeof(s_keys[0]); i++) {
+			if (strcmp(item, s_keys[i].key) != 0) {
+				continue;
+			}
+			v = strtoul(value, &end, 10);
+			if (end == value || *end != '\0' ||
+			    v < s_keys[i].min || v > s_keys[i].max) {
+				ESP_LOGE(__func__, "invalid %s=%s", item, value);
+				return ESP_ERR_INVALID_ARG;
+			}
+			if (*field(&new, s_keys[i].offset) != v &&
+			    s_keys[i].ulp) {
+				*ulp_changed = true;
+			}
+			*field(&new, s_keys[i].offset) = v;
+			/* the raw value wins over the calibrated one */
+			if (s_keys[i].clears >= 0 &&
+			    *field(&new, s_keys[i].clears) != 0) {
+				*field(&new, s_keys[i].clears) = 0;
+				*ulp_changed = true;
+			}
+		}
+	}
+
+	if (memcmp(&new, s_settings, sizeof(new)) == 0) {
+		return ESP_OK;
+	}
+
+	ESP_LOGI(__func__, "settings updated: %s", delta);
+
+	/* the delta comes once, the flash keeps it over a cut of the copy */
+	settings_store(&new);
+	rtc_arena_begin(s_settings);
+	*s_settings = new;
+	rtc_arena_commit(s_settings);
+
+	return ESP_OK;
+}
@@ -0,0 +1,66 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/* response header carrying the configuration delta */
+#define SETTINGS_HEADER "X-Sensor-Config"
+
+/*
+ * Runtime settings, Kconfig gives the defaults.
+ */
+typedef struct {
+	uint32_t t_diff;	/* tdiff (raw) */
+	uint32_t p_diff;	/* pdiff (raw) */
+	uint32_t period;	/* period */
+	uint32_t batch;		/* batch */
+	uint32_t safe_timer;	/* timer (s) */
+	uint32_t flush_stale;	/* stale (s) */
+	uint32_t t_diff_c;	/* tdiff_c (0.01C), 0 uses tdiff */
+	uint32_t p_diff_pa;	/* pdiff_pa (Pa), 0 uses pdiff */
+} settings_t;
+
+/*
+ * Current settings, kept in the RTC arena and NVS.
+ */
+const settings_t *settings_get(void);
+
+/*
+ * Apply the delta "key=value,key=value" sent by the server. Unknown keys
+ * are ignored, a value out of range rejects the whole delta. A raw wake up
+ * difference clears the calibrated one of the same quantity.
+ * *ulp_changed is set when the ULP program parameters changed.
+ */
+esp_err_t settings_apply_delta(const char *delta, bool *ulp_changed);
+
+#endif /* SETTINGS_H */
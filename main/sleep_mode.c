@@ -0,0 +1,156 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <sys/time.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#include "rtc_arena.h"
+#include "sleep_mode.h"
+
+
+#if CONFIG_SLEEP_MODE_AUTO
+/*
+ * Wake interval (ms) below which the cold wake costs more energy than
+ * staying associated in light sleep for the same time.
+ *   E_cold [mJ] / P_connected [mW] = t [s]
+ */
+#define BREAK_EVEN_MS ((uint32_t)CONFIG_MODE_COLD_WAKE_MJ * 1000 / \
+    CONFIG_MODE_CONNECTED_MW)
+
+/* leave the connected mode only when calm well above the break even */
+#define LEAVE_MS (BREAK_EVEN_MS * (100 + CONFIG_MODE_HYSTERESIS) / 100)
+#endif
+
+/* weight of the newest interval in the average is 1/2^AVG_SHIFT */
+#define AVG_SHIFT 2
+
+
+#define STATE_VERSION 1
+
+/* kept in the RTC arena */
+typedef struct {
+	int64_t last_wake;
+	uint32_t mode;
+	uint32_t interval;
+} sleep_mode_state_t;
+
+static sleep_mode_state_t *s_state = NULL;
+
+
+static int64_t time_ms()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static sleep_mode_state_t *state()
+{
+	bool fresh;
+
+	if (s_state == NULL) {
+		rtc_arena_get("sleep_mode", sizeof(*s_state),
+		    STATE_VERSION, (void **)&s_state, &fresh);
+		if (fresh) {
+			s_state->mode = SLEEP_MODE_DEEP;
+			s_state->interval = UINT32_MAX;
+			rtc_arena_commit(s_state);
+		}
+	}
+
+	return s_state;
+}
+
+sleep_mode_t sleep_mode_wake()
+{
+	sleep_mode_state_t *st = state();
+	int64_t now = time_ms();
+	int64_t elapsed = now - st->last_wake;
+
+	rtc_arena_begin(st);
+
+	/* the first wake or the clock was set backwards */
+	if (st->last_wake == 0 || elapsed < 0) {
+		st->last_wake = now;
+		rtc_arena_commit(st);
+		return st->mode;
+	}
+	st->last_wake = now;
+
+	if (elapsed > UINT32_MAX) {
+		elapsed = UINT32_MAX;
+	}
+
+	if (st->interval == UINT32_MAX) {
+		st->interval = elapsed;
+	} else {
+		st->interval = st->interval - (st->interval >> AVG_SHIFT) +
+		    ((uint32_t)elapsed >> AVG_SHIFT);
+	}
+
+#if CONFIG_SLEEP_MODE_AUTO
+	if (st->mode == SLEEP_MODE_DEEP && st->interval < BREAK_EVEN_MS) {
+		ESP_LOGI(__func__, "wake interval %u ms, going connected",
+		    st->interval);
+		st->mode = SLEEP_MODE_CONNECTED;
+	} else if (st->mode == SLEEP_MODE_CONNECTED && st->interval > LEAVE_MS) {
+		ESP_LOGI(__func__, "wake interval %u ms, going to deep sleep",
+		    st->interval);
+		st->mode = SLEEP_MODE_DEEP;
+	}
+#endif
+
+	rtc_arena_commit(st);
+
+	return st->mode;
+}
+
+sleep_mode_t sleep_mode_get()
+{
+	return state()->mode;
+}
+
+uint32_t sleep_mode_interval()
+{
+	return state()->interval;
+}
+
+void sleep_mode_shift_time(int32_t delta)
+{
+	sleep_mode_state_t *st = state();
+
+	if (st->last_wake != 0) {
+		rtc_arena_begin(st);
+		st->last_wake += (int64_t)delta * 1000;
+		rtc_arena_commit(st);
+	}
+}
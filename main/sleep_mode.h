@@ -0,0 +1,60 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SLEEP_MODE_H
+#define SLEEP_MODE_H
+
+#include <stdint.h>
+
+typedef enum {
+	SLEEP_MODE_DEEP = 0,	/* deep sleep, full reboot on every wake */
+	SLEEP_MODE_CONNECTED	/* stay associated in automatic light sleep */
+} sleep_mode_t;
+
+/*
+ * Account one wake (ULP or timer) and re-evaluate the sleep mode.
+ * Returns the mode the device should continue in.
+ */
+sleep_mode_t sleep_mode_wake(void);
+
+/*
+ * Current sleep mode as kept in the RTC memory.
+ */
+sleep_mode_t sleep_mode_get(void);
+
+/*
+ * Averaged interval between the wakes (ms).
+ */
+uint32_t sleep_mode_interval(void);
+
+/*
+ * Move the last wake time, used when the clock was set.
+ */
+void sleep_mode_shift_time(int32_t delta);
+
+#endif /* SLEEP_MODE_H */
@@ -0,0 +1,131 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include "driver/rtc_io.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "sdkconfig.h"
+
+#include "sleep_power.h"
+
+
+#define GPIO_MAX 40
+
+#if CONFIG_SLEEP_PD_RTC_FAST
+#define RTC_FAST_ON false
+#else
+#define RTC_FAST_ON true
+#endif
+
+#if CONFIG_SLEEP_PD_RTC_PERIPH
+#define RTC_PERIPH_ON false
+#else
+#define RTC_PERIPH_ON true
+#endif
+
+/* the ULP keeps driving the BMP280 through the deep sleep */
+#ifdef CONFIG_BMP_SDA
+_Static_assert(!(CONFIG_SLEEP_ISOLATE_GPIO & (1ULL << CONFIG_BMP_SDA)),
+    "SLEEP_ISOLATE_GPIO isolates the BMP280 SDA");
+#endif
+#ifdef CONFIG_BMP_SCL
+_Static_assert(!(CONFIG_SLEEP_ISOLATE_GPIO & (1ULL << CONFIG_BMP_SCL)),
+    "SLEEP_ISOLATE_GPIO isolates the BMP280 SCL");
+#endif
+
+/*
+ * Typical deep sleep currents (uA) of the ESP32 datasheet and the BMP280
+ * datasheet, to compare with the measurements.
+ */
+typedef struct {
+	const char *name;
+	bool on;
+	uint32_t ua;
+	const char *why;
+} budget_item_t;
+
+static const budget_item_t s_budget[] = {
+	{ "RTC timer", true, 5, "timer wake up" },
+	{ "RTC slow memory", true, 5, "ULP program, RTC arena" },
+	{ "RTC fast memory", RTC_FAST_ON, 5, "nothing kept" },
+	{ "RTC peripherals", RTC_PERIPH_ON, 100, "ULP, RTC I2C and RTC IO" },
+	{ "BMP280", true, 3, "measurement every ULP period" },
+};
+
+
+void sleep_power_prepare()
+{
+	uint64_t isolate = CONFIG_SLEEP_ISOLATE_GPIO;
+
+	/* the ULP program and the RTC arena */
+	esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_SLOW_MEM, ESP_PD_OPTION_ON);
+
+	/* the ULP drives the BMP280 over the RTC I2C and the RTC IO */
+	esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_PERIPH, RTC_PERIPH_ON ?
+	    ESP_PD_OPTION_ON : ESP_PD_OPTION_OFF);
+
+#if CONFIG_SLEEP_PD_RTC_FAST
+	esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_FAST_MEM, ESP_PD_OPTION_OFF);
+#endif
+
+#if CONFIG_SLEEP_PD_XTAL
+	esp_sleep_pd_config(ESP_PD_DOMAIN_XTAL, ESP_PD_OPTION_OFF);
+#else
+	esp_sleep_pd_config(ESP_PD_DOMAIN_XTAL, ESP_PD_OPTION_ON);
+#endif
+
+	/* no leakage through the external pull ups and downs */
+	for (int gpio = 0; gpio < GPIO_MAX; gpio++) {
+		if ((isolate & (1ULL << gpio)) &&
+		    rtc_gpio_is_valid_gpio(gpio)) {
+			rtc_gpio_isolate(gpio);
+		}
+	}
+}
+
+void sleep_power_budget()
+{
+	uint32_t total = 0;
+
+	ESP_LOGI(__func__, "estimated deep sleep current:");
+
+	for (int i = 0; i < sizeof(s_budget) / sizeof(s_budget[0]); i++) {
+		ESP_LOGI(__func__, "  %-16s %-3s %4u uA  %s", s_budget[i].name,
+		    s_budget[i].on ? "on" : "off",
+		    s_budget[i].on ? s_budget[i].ua : 0, s_budget[i].why);
+		if (s_budget[i].on) {
+			total += s_budget[i].ua;
+		}
+	}
+
+	ESP_LOGI(__func__, "  %-16s     %4u uA", "total", total);
+#if !CONFIG_SLEEP_PD_XTAL
+	ESP_LOGW(__func__, "  XTAL kept on, not in the estimate");
+#endif
+}
@@ -0,0 +1,102 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <time.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#include "rtc_arena.h"
+#include "sntp_retry.h"
+
+
+#define RETRY_VERSION 1
+
+/* the interval after the first failure (s) */
+#define BACKOFF_MIN 300
+
+
+/* failed attempts kept in the RTC arena */
+typedef struct {
+	uint32_t failures;
+	uint32_t next;		/* s, the clock is not set */
+} sntp_retry_t;
+
+static sntp_retry_t *s_retry = NULL;
+
+
+static sntp_retry_t *retry()
+{
+	bool fresh;
+
+	if (s_retry == NULL) {
+		rtc_arena_get("sntp", sizeof(*s_retry),
+		    RETRY_VERSION, (void **)&s_retry, &fresh);
+	}
+
+	return s_retry;
+}
+
+bool sntp_retry_due(time_t now)
+{
+	sntp_retry_t *r = retry();
+
+	if (CONFIG_SNTP_SERVER[0] == '\0') {
+		return false;
+	}
+
+	/* the clock went back, do not wait longer than the backoff */
+	return r->failures == 0 || now >= r->next ||
+	    r->next - now > CONFIG_SNTP_BACKOFF_MAX;
+}
+
+void sntp_retry_done(bool synced, time_t now)
+{
+	sntp_retry_t *r = retry();
+	uint32_t backoff = CONFIG_SNTP_BACKOFF_MAX;
+
+	rtc_arena_begin(r);
+
+	if (synced) {
+		r->failures = 0;
+		r->next = 0;
+	} else {
+		/* the shift stops before the width of the type */
+		if (r->failures < 16 &&
+		    ((uint32_t)BACKOFF_MIN << r->failures) < backoff) {
+			backoff = (uint32_t)BACKOFF_MIN << r->failures;
+		}
+		r->failures++;
+		r->next = now + backoff;
+		ESP_LOGI(__func__, "SNTP failed %u times, next in %u s",
+		    r->failures, backoff);
+	}
+
+	rtc_arena_commit(r);
+}
@@ -28,6 +28,8 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
@@ -38,47 +40,152 @@
 #include "nvs_flash.h"
 #include "esp_sleep.h"
 #include "esp_http_client.h"
+#include "esp_timer.h"
+#include "esp_sntp.h"
+#if CONFIG_NET_OPENETH
+#include "esp_eth.h"
+#endif
+#if CONFIG_SLEEP_MODE_AUTO
+#include "freertos/semphr.h"
+#include "esp_pm.h"
+#include "driver/rtc_cntl.h"
+#include "soc/rtc_cntl_reg.h"
+#endif
 
 #include "bmp280_ulp_driver.h"
+#include "boot_time.h"
+#if CONFIG_BMP_CALIB
+#include "bmp280_calib.h"
+#endif
+#if CONFIG_BLE_ADV
+#include "ble_adv.h"
+#endif
+#if CONFIG_DIAG_EXPORT
+#include "diag.h"
+#endif
+#include "event_log.h"
+#include "fields.h"
+#include "flush_sched.h"
+#include "rtc_arena.h"
+#include "sample_buf.h"
+#include "settings.h"
+#include "sleep_mode.h"
+#include "sleep_power.h"
+#if !CONFIG_NET_OPENETH
+#include "sntp_retry.h"
+#endif
+#include "upload.h"
+#include "wake_cycle.h"
+#include "wake_sched.h"
+#include "wifi_retry.h"
+#if CONFIG_METRICS_SERVER
+#include "metrics.h"
+#endif
 
 
 #define INFLUX_URL "http://" CONFIG_INFLUX_IP ":" CONFIG_INFLUX_PORT \
-    "/write?db=" CONFIG_INFLUX_DB
-#define INFLUX_TAG  CONFIG_INFLUX_MEAS ",site=" CONFIG_INFLUX_SITE ",place=" \
-    CONFIG_INFLUX_PLACE
+    "/write?db=" CONFIG_INFLUX_DB "&precision=s"
 
-#define BUF_SIZE 128
+/* longest settings delta in the response header */
+#define DELTA_SIZE 128
+
+#define SNTP_TIMEOUT_MS 5000
+
+/* Ethernet link and DHCP in QEMU are immediate */
+#define ETH_TIMEOUT_MS 10000
+
+/* upload time left to the history after the priority request */
+#define UPLOAD_BUDGET_US ((int64_t)CONFIG_UPLOAD_BUDGET_MS * 1000)
+
+#if CONFIG_NET_OPENETH
+#define net_start eth_start
+#else
+#define net_start wifi_start
+#endif
+
+/* QEMU emulates neither the ULP nor the RTC I2C */
+#if CONFIG_BMP_MOCK
+#define BMP_MOCK 1
+#define sensor_temp() (21.50f)
+#define sensor_pres() (1013.25f)
+#else
+#define BMP_MOCK 0
+#define sensor_temp() bmp280_ulp_get_temp()
+#define sensor_pres() bmp280_ulp_get_pres()
+#endif
+
+/* lowest CPU frequency in the connected mode is the XTAL one */
+#define CONNECTED_MIN_FREQ 40
 
 
 #define WIFI_CONNECTED_BIT BIT0
 #define WIFI_FAIL_BIT      BIT1
 
+/* the BLE advertising needs neither the network nor the server */
+#if !CONFIG_BLE_ADV
 static EventGroupHandle_t s_wifi_event_group;
-int s_retry_num = 0;
 
+static char s_settings_delta[DELTA_SIZE];
+
+
+#if !CONFIG_NET_OPENETH
+static wifi_retry_t s_retry;
+static esp_timer_handle_t s_retry_timer;
+
+static void wifi_retry_cb(void *arg)
+{
+	esp_wifi_connect();
+}
 
 /*
- * Generic WIFI event handler taken from examples.
+ * Scan all the channels on the next connect, the AP may have moved.
+ */
+static void wifi_rescan()
+{
+	wifi_config_t wifi_config;
+
+	if (esp_wifi_get_config(WIFI_IF_STA, &wifi_config) == ESP_OK) {
+		wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+		esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+	}
+}
+
+/*
+ * Generic WIFI event handler taken from examples, the reconnect is delayed
+ * by the wifi_retry policy.
  */
 static void wifi_event_handler(void* arg, esp_event_base_t event_base,
     int32_t event_id, void* event_data)
 {
+	wifi_event_sta_disconnected_t* disconnected;
+	uint32_t delay;
+
 	if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
 		esp_wifi_connect();
 	} else if (event_base == WIFI_EVENT &&
 	    event_id == WIFI_EVENT_STA_DISCONNECTED) {
-		if (s_retry_num < CONFIG_MAXIMUM_RETRY) {
-			esp_wifi_connect();
-			s_retry_num++;
-			ESP_LOGI(__func__, "retry to connect to the AP");
-		} else {
-			xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
+		disconnected = (wifi_event_sta_disconnected_t*) event_data;
+		ESP_LOGI(__func__, "connect to the AP failed, reason %d",
+		    disconnected->reason);
+		switch (wifi_retry_next(&s_retry, disconnected->reason,
+		    esp_timer_get_time(), esp_random(), &delay)) {
+			case WIFI_RETRY_RESCAN:
+				wifi_rescan();
+				/* FALLTHROUGH */
+			case WIFI_RETRY_DELAY:
+				ESP_LOGI(__func__, "retry to connect to the AP "
+				    "in %u ms", delay);
+				esp_timer_start_once(s_retry_timer,
+				    (uint64_t)delay * 1000);
+				break;
+			case WIFI_RETRY_ABORT:
+				xEventGroupSetBits(s_wifi_event_group,
+				    WIFI_FAIL_BIT);
+				break;
 		}
-		ESP_LOGI(__func__, "connect to the AP failed");
 	} else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
 		ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
 		ESP_LOGI(__func__, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
-		s_retry_num = 0;
 		xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
 	}
 }
@@ -93,6 +200,12 @@ static int wifi_start()
 	esp_event_handler_instance_t instance_any_id;
 	esp_event_handler_instance_t instance_got_ip;
 	EventBits_t bits;
+	int64_t start;
+	wifi_ap_record_t ap;
+	esp_timer_create_args_t retry_timer_args = {
+		.callback = &wifi_retry_cb,
+		.name = "wifi_retry"
+	};
 	wifi_config_t wifi_config = {
 		.sta = {
 			.ssid = CONFIG_WIFI_SSID,
@@ -135,6 +248,11 @@ static int wifi_start()
 
 	ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
 	ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+
+	ESP_ERROR_CHECK(esp_timer_create(&retry_timer_args, &s_retry_timer));
+
+	start = esp_timer_get_time();
+	wifi_retry_init(&s_retry, start);
 	ESP_ERROR_CHECK(esp_wifi_start());
 
 	ESP_LOGI(__func__, "wifi_init_sta finished.");
@@ -144,29 +262,182 @@ static int wifi_start()
 	    WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
 	    pdFALSE,
 	    pdFALSE,
-	    portMAX_DELAY);
+	    pdMS_TO_TICKS(CONFIG_WIFI_CONNECT_TIMEOUT));
 
 	if (bits & WIFI_CONNECTED_BIT) {
 		ESP_LOGI(__func__, "connected to ap SSID:%s password:%s",
 		    CONFIG_WIFI_SSID, CONFIG_WIFI_PASSWORD);
+		ap.rssi = 0;
+		esp_wifi_sta_get_ap_info(&ap);
+		flush_sched_record(true, ap.rssi, s_retry.attempt,
+		    (esp_timer_get_time() - start) / 1000);
 	} else if (bits & WIFI_FAIL_BIT) {
 		ESP_LOGI(__func__, "Failed to connect to SSID:%s, password:%s",
 		    CONFIG_WIFI_SSID, CONFIG_WIFI_PASSWORD);
 		ret = ESP_ERR_WIFI_NOT_CONNECT;
 	} else {
-		ESP_LOGE(__func__, "UNEXPECTED EVENT");
+		ESP_LOGI(__func__, "Timeout connecting to SSID:%s",
+		    CONFIG_WIFI_SSID);
 		ret = ESP_ERR_WIFI_NOT_CONNECT;
 	}
 
+	if (ret != ESP_OK) {
+		flush_sched_record(false, 0, s_retry.attempt,
+		    (esp_timer_get_time() - start) / 1000);
+	}
+
 	/* The event will not be processed after unregister */
 	ESP_ERROR_CHECK(esp_event_handler_instance_unregister(IP_EVENT,
 		    IP_EVENT_STA_GOT_IP, instance_got_ip));
 	ESP_ERROR_CHECK(esp_event_handler_instance_unregister(WIFI_EVENT,
 		    ESP_EVENT_ANY_ID, instance_any_id));
+	esp_timer_stop(s_retry_timer);
+	esp_timer_delete(s_retry_timer);
 	vEventGroupDelete(s_wifi_event_group);	
 
 	return ret;
 }
+#else
+static void eth_event_handler(void* arg, esp_event_base_t event_base,
+    int32_t event_id, void* event_data)
+{
+	ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
+
+	ESP_LOGI(__func__, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
+	xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+}
+
+/*
+ * Bring up the OpenCores Ethernet MAC emulated by QEMU instead of WIFI.
+ */
+static int eth_start()
+{
+	esp_err_t ret = ESP_OK;
+	esp_eth_handle_t eth_handle = NULL;
+	esp_netif_config_t netif_cfg = ESP_NETIF_DEFAULT_ETH();
+	eth_mac_config_t mac_config = ETH_MAC_DEFAULT_CONFIG();
+	eth_phy_config_t phy_config = ETH_PHY_DEFAULT_CONFIG();
+	esp_event_handler_instance_t instance_got_ip;
+	esp_netif_t *netif;
+	esp_eth_mac_t *mac;
+	esp_eth_phy_t *phy;
+	EventBits_t bits;
+
+	s_wifi_event_group = xEventGroupCreate();
+
+	ESP_ERROR_CHECK(esp_netif_init());
+	ESP_ERROR_CHECK(esp_event_loop_create_default());
+	netif = esp_netif_new(&netif_cfg);
+
+	ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
+		    IP_EVENT_ETH_GOT_IP,
+		    &eth_event_handler,
+		    NULL,
+		    &instance_got_ip));
+
+	phy_config.autonego_timeout_ms = 100;
+	mac = esp_eth_mac_new_openeth(&mac_config);
+	phy = esp_eth_phy_new_dp83848(&phy_config);
+
+	esp_eth_config_t config = ETH_DEFAULT_CONFIG(mac, phy);
+	ESP_ERROR_CHECK(esp_eth_driver_install(&config, &eth_handle));
+	ESP_ERROR_CHECK(esp_netif_attach(netif,
+		    esp_eth_new_netif_glue(eth_handle)));
+	ESP_ERROR_CHECK(esp_eth_start(eth_handle));
+
+	bits = xEventGroupWaitBits(s_wifi_event_group,
+	    WIFI_CONNECTED_BIT,
+	    pdFALSE,
+	    pdFALSE,
+	    pdMS_TO_TICKS(ETH_TIMEOUT_MS));
+
+	if (!(bits & WIFI_CONNECTED_BIT)) {
+		ESP_LOGE(__func__, "no address on the Ethernet");
+		ret = ESP_FAIL;
+	}
+
+	ESP_ERROR_CHECK(esp_event_handler_instance_unregister(IP_EVENT,
+		    IP_EVENT_ETH_GOT_IP, instance_got_ip));
+	vEventGroupDelete(s_wifi_event_group);
+
+	return ret;
+}
+#endif
+#endif /* !CONFIG_BLE_ADV */
+
+/*
+ * ULP thresholds in raw steps, the differences in 0.01C and Pa are
+ * converted with the sensor calibration when set.
+ */
+static uint32_t ulp_t_diff()
+{
+#if CONFIG_BMP_CALIB
+	if (settings_get()->t_diff_c != 0) {
+		return bmp280_calib_t_diff(settings_get()->t_diff_c);
+	}
+#endif
+	return settings_get()->t_diff;
+}
+
+static uint32_t ulp_p_diff()
+{
+#if CONFIG_BMP_CALIB
+	if (settings_get()->p_diff_pa != 0) {
+		return bmp280_calib_p_diff(settings_get()->p_diff_pa);
+	}
+#endif
+	return settings_get()->p_diff;
+}
+
+/*
+ * Configure the ULP program from the current settings.
+ */
+static void ulp_setup()
+{
+	const settings_t *settings = settings_get();
+	bmp280_ulp_config_t config = {
+		.osrs_t = CONFIG_BMP_OSRST,
+		.osrs_p = CONFIG_BMP_OSRSP,
+		.filter = CONFIG_BMP_FILTER,
+		.t_diff = ulp_t_diff(),
+		.p_diff = ulp_p_diff(),
+		.period = settings->period
+	};
+
+	bmp280_ulp_setup(&config);
+}
+
+/*
+ * Read the current measurement, the diagnostic frame carries it with the
+ * samples buffered before.
+ */
+static void sample_read(float value[SAMPLE_FIELDS])
+{
+	value[SAMPLE_TEMP] = sensor_temp();
+	value[SAMPLE_PRES] = sensor_pres();
+
+#if CONFIG_DIAG_EXPORT
+	diag_export(value);
+#endif
+}
+
+#if !CONFIG_BLE_ADV
+/*
+ * Apply the settings delta the server attached to the response.
+ */
+static void settings_update()
+{
+	bool ulp_changed;
+
+	if (s_settings_delta[0] == '\0') {
+		return;
+	}
+
+	if (settings_apply_delta(s_settings_delta, &ulp_changed) == ESP_OK &&
+	    ulp_changed && !BMP_MOCK) {
+		ulp_setup();
+	}
+}
 
 /*
  * Generic handler to debug http response.
@@ -175,102 +446,299 @@ esp_err_t http_event_handler(esp_http_client_event_t *evt)
 {
 	switch(evt->event_id) {
 		case HTTP_EVENT_ERROR:
-			ESP_LOGI(__func__, "HTTP_EVENT_ERROR");
+			event_log(EV_HTTP_ERROR, 0, 0);
 			break;
 		case HTTP_EVENT_ON_CONNECTED:
-			ESP_LOGI(__func__, "HTTP_EVENT_ON_CONNECTED");
+			event_log(EV_HTTP_CONNECTED, 0, 0);
 			break;
 		case HTTP_EVENT_HEADER_SENT:
-			ESP_LOGI(__func__, "HTTP_EVENT_HEADER_SENT");
+			event_log(EV_HTTP_HEADER_SENT, 0, 0);
 			break;
 		case HTTP_EVENT_ON_HEADER:
-			ESP_LOGI(__func__, "HTTP_EVENT_ON_HEADER");
+			event_log(EV_HTTP_HEADER, evt->data_len, 0);
+#if !CONFIG_EVENT_LOG
 			printf("%.*s", evt->data_len, (char*)evt->data);
+#endif
+			if (strcasecmp(evt->header_key, SETTINGS_HEADER) == 0 &&
+			    strlcpy(s_settings_delta, evt->header_value,
+			    DELTA_SIZE) >= DELTA_SIZE) {
+				event_log(EV_DELTA_TOO_LONG, 0, 0);
+				s_settings_delta[0] = '\0';
+			}
 			break;
 		case HTTP_EVENT_ON_DATA:
-			ESP_LOGI(__func__, "HTTP_EVENT_ON_DATA, len=%d",
-			    evt->data_len);
+			event_log(EV_HTTP_DATA, evt->data_len, 0);
+#if !CONFIG_EVENT_LOG
 			if (!esp_http_client_is_chunked_response(evt->client)) {
 				printf("%.*s", evt->data_len, (char*)evt->data);
 			}
+#endif
 			break;
 		case HTTP_EVENT_ON_FINISH:
-			ESP_LOGI(__func__, "HTTP_EVENT_ON_FINISH");
+			event_log(EV_HTTP_FINISH, 0, 0);
 			break;
 		case HTTP_EVENT_DISCONNECTED:
-			ESP_LOGI(__func__, "HTTP_EVENT_DISCONNECTED");
+			event_log(EV_HTTP_DISCONNECTED, 0, 0);
 			break;
 	}
 	return ESP_OK;
 }
 
+#if !CONFIG_NET_OPENETH
+/*
+ * Set the clock over SNTP when not set yet and move the time of the samples
+ * taken before by the same step. A failure is not retried on every wake,
+ * without the server the latest sample is sent with the server time.
+ */
+static void time_sync()
+{
+	time_t before = time(NULL);
+	int64_t start = esp_timer_get_time();
+	int32_t step;
+
+	if (before >= TIME_VALID || !sntp_retry_due(before)) {
+		return;
+	}
+
+	sntp_setoperatingmode(SNTP_OPMODE_POLL);
+	sntp_setservername(0, CONFIG_SNTP_SERVER);
+	sntp_init();
+
+	while (sntp_get_sync_status() != SNTP_SYNC_STATUS_COMPLETED &&
+	    esp_timer_get_time() - start < SNTP_TIMEOUT_MS * 1000) {
+		vTaskDelay(pdMS_TO_TICKS(100));
+	}
+
+	sntp_stop();
+
+	if (time(NULL) >= TIME_VALID) {
+		step = time(NULL) - before -
+		    (esp_timer_get_time() - start) / 1000000;
+		sample_buf_shift_time(step);
+		wake_sched_shift_time(step);
+		sleep_mode_shift_time(step);
+		sntp_retry_done(true, time(NULL));
+	} else {
+		ESP_LOGE(__func__, "failed to set the time");
+		sntp_retry_done(false, time(NULL));
+	}
+}
+#endif
+
 /*
- * Send the data to the influxdb server.
+ * Bring the network up for the upload.
  */
-static void send_data()
+static esp_err_t net_connect()
+{
+	esp_err_t err = net_start();
+
+#if !CONFIG_NET_OPENETH
+	/* the QEMU user network has no SNTP server */
+	if (err == ESP_OK) {
+		time_sync();
+	}
+#endif
+
+	return err;
+}
+
+/*
+ * POST n encoded samples to the influxdb server, the settings delta of
+ * the response is applied on success.
+ */
+static esp_err_t post_data(const char *data, size_t len, int n)
 {
 	esp_err_t err;
 	esp_http_client_handle_t client;
-	float temp = bmp280_ulp_get_temp();
-	float pres = bmp280_ulp_get_pres();
-	char * data = (char*)malloc(BUF_SIZE);
+	int status;
 
 	esp_http_client_config_t config = {
 		.url = INFLUX_URL,
 		.event_handler = http_event_handler,
 	};
 
-	if(data == NULL) {
-		return;
-	}
-
-	/* store the measurements and INFLUX_TAG in the buffer */
-	snprintf(data, BUF_SIZE, INFLUX_TAG " temp=%0.2f\n" INFLUX_TAG
-	    " pres=%0.2f\n", temp, pres);
+	s_settings_delta[0] = '\0';
 
+	/* the binary log keeps the sizes only */
+	event_log(EV_POST, n, len);
+#if !CONFIG_EVENT_LOG
 	ESP_LOGI(__func__, "Influxdb url: %s\n", INFLUX_URL);
-	ESP_LOGI(__func__, "Sent data:");
 	printf("%s", data);
+#endif
 
 	client = esp_http_client_init(&config);
 	esp_http_client_set_method(client, HTTP_METHOD_POST);
-	esp_http_client_set_post_field(client, data, strlen(data));
+	esp_http_client_set_post_field(client, data, len);
 
 	err = esp_http_client_perform(client);
 	if (err == ESP_OK) {
-		ESP_LOGI(__func__, "Status = %d, content_length = %lld",
-		    esp_http_client_get_status_code(client),
+		status = esp_http_client_get_status_code(client);
+		event_log(EV_POST_STATUS, status,
 		    esp_http_client_get_content_length(client));
+		if (status / 100 == 2) {
+			settings_update();
+		} else {
+			err = ESP_FAIL;
+		}
 	}
 
 	esp_http_client_cleanup(client);
 
-	free(data);
+	return err;
 }
+#endif /* !CONFIG_BLE_ADV */
 
-void app_main()
+#if CONFIG_SLEEP_MODE_AUTO
+static SemaphoreHandle_t s_ulp_sem;
+
+/*
+ * The ULP wake instruction raises an interrupt while the CPU is running.
+ */
+static void IRAM_ATTR ulp_isr(void *arg)
 {
-	bmp280_ulp_config_t config = {
-		.osrs_t = CONFIG_BMP_OSRST,
-		.osrs_p = CONFIG_BMP_OSRSP,
-		.filter = CONFIG_BMP_FILTER,
-		.t_diff = CONFIG_BMP_TDIFF,
-		.p_diff = CONFIG_BMP_PDIFF,
-		.period = CONFIG_BMP_PERIOD
+	BaseType_t woken = pdFALSE;
+
+	xSemaphoreGiveFromISR(s_ulp_sem, &woken);
+	if (woken == pdTRUE) {
+		portYIELD_FROM_ISR();
+	}
+}
+
+/*
+ * The ticks of a sleep (us), pdMS_TO_TICKS() multiplies in 32 bits and
+ * overflows for the sleeps over 71 minutes at 1000 Hz.
+ */
+static TickType_t sleep_ticks(uint64_t us)
+{
+	uint64_t ticks = us / 1000 * configTICK_RATE_HZ / 1000;
+
+	/* portMAX_DELAY itself waits forever */
+	if (ticks >= portMAX_DELAY) {
+		ticks = portMAX_DELAY - 1;
+	}
+
+	return ticks;
+}
+
+/*
+ * Stay associated in automatic light sleep and send the data on every ULP
+ * wake until the wake rate calms down or the AP is lost.
+ */
+static void connected_loop()
+{
+	wifi_ap_record_t ap;
+	float value[SAMPLE_FIELDS];
+	bool forced;
+	esp_pm_config_esp32_t pm_config = {
+		.max_freq_mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+		.min_freq_mhz = CONNECTED_MIN_FREQ,
+		.light_sleep_enable = true
 	};
 
-	esp_sleep_enable_timer_wakeup(((uint64_t)CONFIG_SAFE_TIMER * 1000000));
+	if (sleep_mode_get() != SLEEP_MODE_CONNECTED) {
+		return;
+	}
+
+	s_ulp_sem = xSemaphoreCreateBinary();
+	ESP_ERROR_CHECK(rtc_isr_register(&ulp_isr, NULL,
+		    RTC_CNTL_SAR_INT_ST_M));
+	REG_SET_BIT(RTC_CNTL_INT_ENA_REG, RTC_CNTL_ULP_CP_INT_ENA_M);
+
+	ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_MIN_MODEM));
+	ESP_ERROR_CHECK(esp_pm_configure(&pm_config));
 
-	if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_UNDEFINED) {
-		bmp280_ulp_setup(&config);
+	bmp280_ulp_enable();
+
+	ESP_LOGI(__func__, "Entering connected mode\n");
+
+#if CONFIG_METRICS_SERVER
+	metrics_update(sensor_temp(), sensor_pres());
+	metrics_start();
+#endif
+
+	while (sleep_mode_get() == SLEEP_MODE_CONNECTED) {
+		xSemaphoreTake(s_ulp_sem, sleep_ticks(wake_sched_next()));
+		if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK) {
+			break;
+		}
+		sleep_mode_wake();
+		forced = wake_sched_due() != 0;
+		sample_read(value);
+		wake_cycle_sample(value);
+#if CONFIG_METRICS_SERVER
+		metrics_update(value[SAMPLE_TEMP], value[SAMPLE_PRES]);
+#endif
+		/* the ULP wakes send the fields due by their cadence only */
+		upload_send(post_data, esp_timer_get_time() + UPLOAD_BUDGET_US,
+		    forced || sample_buf_count() == CONFIG_SAMPLE_BUF_SIZE);
+		event_log_dump();
+	}
+
+#if CONFIG_METRICS_SERVER
+	metrics_stop();
+#endif
+
+	REG_CLR_BIT(RTC_CNTL_INT_ENA_REG, RTC_CNTL_ULP_CP_INT_ENA_M);
+	rtc_isr_deregister(&ulp_isr, NULL);
+	vSemaphoreDelete(s_ulp_sem);
+}
+#endif
+
+void app_main()
+{
+	int64_t start = esp_timer_get_time();
+	esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
+	float value[SAMPLE_FIELDS];
+#if !CONFIG_BLE_ADV
+	/* the budget counts from the boot */
+	const wake_cycle_t cycle = {
+		.connect = net_connect,
+		.post = post_data,
+#if CONFIG_SLEEP_MODE_AUTO
+		.online = connected_loop,
+#endif
+		.budget_end = UPLOAD_BUDGET_US
+	};
+#endif
+
+	boot_time_log();
+
+	if (cause == ESP_SLEEP_WAKEUP_UNDEFINED && !BMP_MOCK) {
+#if CONFIG_BMP_CALIB
+		/* the nominal conversion stays on failure */
+		bmp280_calib_read();
+#endif
+		ulp_setup();
+		sleep_power_budget();
+		wake_cycle_arm();
 	} else {
-		if (wifi_start() == ESP_OK) {
-			send_data();
+		sleep_mode_wake();
+		sample_read(value);
+#if CONFIG_BLE_ADV
+		wake_cycle_sample(value);
+		/* there is no acknowledge, advertise the latest sample only */
+		wake_sched_due();
+		if (ble_adv_send(sample_buf_get(sample_buf_count() - 1)) ==
+		    ESP_OK) {
+			sample_buf_drop(sample_buf_count());
 		}
+		wake_cycle_arm();
+#else
+		wake_cycle_run(value, &cycle);
+#endif
 	}
 
+#if !CONFIG_BMP_MOCK
 	bmp280_ulp_enable();
+#endif
+
+	sleep_power_prepare();
+
+	event_log_dump();
+	rtc_arena_commit_all();
 
+	ESP_LOGI(__func__, "app_main to sleep %lld us",
+	    esp_timer_get_time() - start);
 	ESP_LOGI(__func__, "Entering deep sleep\n");
 	vTaskDelay(20);
 	esp_deep_sleep_start();
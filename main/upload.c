@@ -0,0 +1,289 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#include "compress.h"
+#include "event_log.h"
+#include "fields.h"
+#include "upload.h"
+
+
+#define INFLUX_TAG  CONFIG_INFLUX_MEAS ",site=" CONFIG_INFLUX_SITE ",place=" \
+    CONFIG_INFLUX_PLACE
+
+/*
+ * One field line without INFLUX_TAG:
+ * " pres=%0.2f,pres_min=%0.2f,pres_max=%0.2f,n=%ui,age=%ui %u\n"
+ */
+#define LINE_SIZE 128
+
+/* buffer for n samples of all the fields */
+#define DATA_SIZE(n) ((n) * SAMPLE_FIELDS * (sizeof(INFLUX_TAG) + \
+    LINE_SIZE) + 1)
+
+
+/*
+ * Append to the buffer, len is set to size on overflow.
+ */
+static void append(char *buf, size_t size, size_t *len, const char *fmt, ...)
+{
+	va_list ap;
+	int ret;
+
+	if (*len >= size) {
+		return;
+	}
+
+	va_start(ap, fmt);
+	ret = vsnprintf(buf + *len, size - *len, fmt, ap);
+	va_end(ap);
+
+	*len = (ret < 0 || *len + ret >= size) ? size : *len + ret;
+}
+
+/*
+ * Store one point of one field in the buffer, with the sample time when the
+ * clock is set. The buckets of the merged samples carry their min, max and
+ * the sample count.
+ */
+void upload_encode_line(char *buf, size_t size, size_t *len,
+    sample_field_id_t f, const sample_t *sample)
+{
+	const field_desc_t *desc = &field_desc[f];
+#if CONFIG_INFLUX_AGE
+	uint32_t now = time(NULL);
+#endif
+
+	append(buf, size, len, INFLUX_TAG " %s=%0.*f", desc->name,
+	    desc->precision, sample->field[f].mean);
+	if (sample->count > 1) {
+		append(buf, size, len, ",%s_min=%0.*f,%s_max=%0.*f,n=%ui",
+		    desc->name, desc->precision, sample->field[f].min,
+		    desc->name, desc->precision, sample->field[f].max,
+		    sample->count);
+	}
+#if CONFIG_INFLUX_AGE
+	/* the time from the sample to the upload */
+	if (sample->time >= TIME_VALID && now >= sample->time) {
+		append(buf, size, len, ",age=%ui", now - sample->time);
+	}
+#endif
+	if (sample->time >= TIME_VALID) {
+		append(buf, size, len, " %u", sample->time);
+	}
+	append(buf, size, len, "\n");
+}
+
+/*
+ * Store the points of one field of n oldest samples kept by the compression
+ * in the buffer. The buckets are always kept.
+ */
+static void encode_field(char *buf, size_t size, size_t *len,
+    sample_field_id_t f, int n)
+{
+	const sample_t *sample;
+	uint32_t t[CONFIG_SAMPLE_BUF_SIZE];
+	float v[CONFIG_SAMPLE_BUF_SIZE];
+	bool keep[CONFIG_SAMPLE_BUF_SIZE];
+
+	for (int i = 0; i < n; i++) {
+		sample = sample_buf_get(i);
+		t[i] = sample->time;
+		v[i] = sample->field[f].mean;
+	}
+
+	compress_sdt(t, v, n, field_desc[f].err, keep);
+
+	for (int i = 0; i < n; i++) {
+		sample = sample_buf_get(i);
+		if (keep[i] || sample->count > 1) {
+			upload_encode_line(buf, size, len, f, sample);
+		}
+	}
+}
+
+/*
+ * Send the alert samples and the latest one uncompressed in their own small
+ * request, ahead of the buffered history. Only the latest one without the
+ * alerts.
+ */
+static esp_err_t send_priority(upload_post_t post, uint32_t mask,
+    bool alerts)
+{
+	esp_err_t err;
+	int n = sample_buf_count();
+	int pick[CONFIG_SAMPLE_BUF_SIZE];
+	int k = 0;
+	size_t size;
+	size_t len = 0;
+	char * data;
+
+	for (int i = 0; i < n; i++) {
+		if (i == n - 1 ||
+		    (alerts && (sample_buf_get(i)->flags & SAMPLE_ALERT))) {
+			pick[k++] = i;
+		}
+	}
+
+	size = DATA_SIZE(k);
+	data = (char*)malloc(size);
+	if(data == NULL) {
+		return ESP_ERR_NO_MEM;
+	}
+
+	for (int f = 0; f < SAMPLE_FIELDS; f++) {
+		if (!(mask & (1 << f))) {
+			continue;
+		}
+		for (int j = 0; j < k; j++) {
+			upload_encode_line(data, size, &len, f,
+			    sample_buf_get(pick[j]));
+		}
+	}
+	if (len >= size) {
+		event_log(EV_POST_OVERFLOW, 0, 0);
+		free(data);
+		return ESP_ERR_NO_MEM;
+	}
+
+	err = post(data, len, k);
+	if (err == ESP_OK) {
+		fields_sent(mask);
+		/* from the newest, the lower indexes stay valid */
+		for (int j = k - 1; j >= 0; j--) {
+			sample_buf_remove(pick[j]);
+		}
+	}
+
+	free(data);
+
+	return err;
+}
+
+/*
+ * Send n oldest samples of the buffered history. The latest sample is
+ * recorded as the last upload of the fields unless the priority request
+ * sent a newer one before.
+ */
+static esp_err_t send_bulk(upload_post_t post, uint32_t mask, int n,
+    bool priority)
+{
+	esp_err_t err;
+	size_t size = DATA_SIZE(n);
+	size_t len = 0;
+	char * data;
+
+	data = (char*)malloc(size);
+	if(data == NULL) {
+		return ESP_ERR_NO_MEM;
+	}
+
+	/* store the measurements and INFLUX_TAG in the buffer */
+	for (int f = 0; f < SAMPLE_FIELDS; f++) {
+		if (mask & (1 << f)) {
+			encode_field(data, size, &len, f, n);
+		}
+	}
+	if (len >= size) {
+		event_log(EV_POST_OVERFLOW, 0, 0);
+		free(data);
+		return ESP_ERR_NO_MEM;
+	}
+
+	err = post(data, len, n);
+	if (err == ESP_OK) {
+		if (!priority && n == sample_buf_count()) {
+			fields_sent(mask);
+		}
+		sample_buf_drop(n);
+	}
+
+	free(data);
+
+	return err;
+}
+
+esp_err_t upload_send(upload_post_t post, int64_t budget_end, bool forced)
+{
+	esp_err_t err = ESP_OK;
+	uint32_t mask;
+	bool changed;
+	bool priority = false;
+	bool sent = false;
+	int n;
+
+	if (sample_buf_count() == 0) {
+		return ESP_OK;
+	}
+
+	/* a forced flush with no field due still drains the buffer */
+	mask = fields_due(&changed);
+	if (mask == 0) {
+		if (!forced) {
+			return ESP_OK;
+		}
+		mask = (1 << SAMPLE_FIELDS) - 1;
+	}
+
+	/*
+	 * Without the clock the server stamps the points on the arrival, the
+	 * points of one request would overwrite each other. The history waits
+	 * until the clock is set and the samples are moved by the same step.
+	 */
+	if (time(NULL) < TIME_VALID) {
+		return send_priority(post, mask, false);
+	}
+
+	if (sample_buf_count() > CONFIG_UPLOAD_CHUNK) {
+		err = send_priority(post, mask, true);
+		priority = true;
+		sent = true;
+	}
+
+	while (err == ESP_OK && sample_buf_count() > 0) {
+		if (sent && esp_timer_get_time() >= budget_end) {
+			event_log(EV_BUDGET_SPENT, sample_buf_count(), 0);
+			break;
+		}
+
+		n = sample_buf_count();
+		if (n > CONFIG_UPLOAD_CHUNK) {
+			n = CONFIG_UPLOAD_CHUNK;
+		}
+		err = send_bulk(post, mask, n, priority);
+		sent = true;
+	}
+
+	return err;
+}
@@ -0,0 +1,63 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#include "sample_buf.h"
+
+/* any earlier time means the clock was not set yet (2021-01-01) */
+#define TIME_VALID 1609459200
+
+/*
+ * POST n encoded samples, ESP_OK when the server accepted them.
+ */
+typedef esp_err_t (*upload_post_t)(const char *data, size_t len, int n);
+
+/*
+ * Append the influxdb line of one field of the sample to the buffer, len
+ * is set to size on overflow.
+ */
+void upload_encode_line(char *buf, size_t size, size_t *len,
+    sample_field_id_t f, const sample_t *sample);
+
+/*
+ * Send the fields due of the buffered samples with post, the sent ones
+ * leave the buffer. A backlog longer than one request sends the alerts and
+ * the latest sample first, the history then drains from the oldest until
+ * the budget (esp_timer us) ends. Only the latest sample is sent while the
+ * clock is not set. Nothing is sent while no field is due, unless forced
+ * by a passed deadline or the full buffer, which sends all the fields.
+ */
+esp_err_t upload_send(upload_post_t post, int64_t budget_end, bool forced);
+
+#endif /* UPLOAD_H */
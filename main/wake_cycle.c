@@ -0,0 +1,79 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdbool.h>
+#include <time.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#include "fields.h"
+#include "flush_sched.h"
+#include "sample_buf.h"
+#include "upload.h"
+#include "wake_cycle.h"
+#include "wake_sched.h"
+
+
+void wake_cycle_sample(const float value[SAMPLE_FIELDS])
+{
+	sample_buf_push(time(NULL), value,
+	    fields_alert(value) ? SAMPLE_ALERT : 0);
+}
+
+esp_err_t wake_cycle_run(const float value[SAMPLE_FIELDS],
+    const wake_cycle_t *cycle)
+{
+	esp_err_t err = ESP_OK;
+	bool forced;
+
+	wake_cycle_sample(value);
+
+	/* the flush due by the link cost has a field due */
+	forced = wake_sched_due() != 0 ||
+	    sample_buf_count() == CONFIG_SAMPLE_BUF_SIZE;
+	if (flush_sched_due(forced)) {
+		err = cycle->connect();
+		if (err == ESP_OK) {
+			err = upload_send(cycle->post, cycle->budget_end,
+			    forced);
+			if (cycle->online != NULL) {
+				cycle->online();
+			}
+		}
+	}
+
+	wake_cycle_arm();
+
+	return err;
+}
+
+void wake_cycle_arm()
+{
+	flush_sched_arm();
+	wake_sched_arm();
+}
@@ -0,0 +1,68 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef WAKE_CYCLE_H
+#define WAKE_CYCLE_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#include "sample_buf.h"
+#include "upload.h"
+
+/*
+ * The network of the wake, app_main passes the firmware one and the host
+ * tests their models.
+ */
+typedef struct {
+	esp_err_t (*connect)(void);	/* bring the link up */
+	upload_post_t post;		/* send one request */
+	void (*online)(void);		/* after the upload, NULL none */
+	int64_t budget_end;		/* us, esp_timer_get_time() */
+} wake_cycle_t;
+
+/*
+ * Buffer the reading, flagged when it moved over the threshold of a field.
+ */
+void wake_cycle_sample(const float value[SAMPLE_FIELDS]);
+
+/*
+ * One wake after the boot: buffer the reading, upload when a deadline
+ * passed or the flush is due by the link cost, arm the next wake. Returns
+ * the error of the connect or the upload, ESP_OK when nothing was due.
+ */
+esp_err_t wake_cycle_run(const float value[SAMPLE_FIELDS],
+    const wake_cycle_t *cycle);
+
+/*
+ * Arm the timer wake up for the next deadline, the boots without the
+ * cycle call it before the deep sleep too.
+ */
+void wake_cycle_arm(void);
+
+#endif /* WAKE_CYCLE_H */
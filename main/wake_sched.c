@@ -0,0 +1,169 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <time.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+
+#include "rtc_arena.h"
+#include "settings.h"
+#include "wake_sched.h"
+
+
+#define SCHED_VERSION 1
+
+/* do not arm the timer closer than this */
+#define MIN_SLEEP_US 1000000ULL
+
+
+/* absolute deadlines kept in the RTC arena */
+typedef struct {
+	uint32_t deadline[WAKE_MAX];
+} wake_sched_t;
+
+static wake_sched_t *s_sched = NULL;
+
+
+static wake_sched_t *sched()
+{
+	bool fresh;
+
+	if (s_sched == NULL) {
+		rtc_arena_get("wake_sched", sizeof(*s_sched),
+		    SCHED_VERSION, (void **)&s_sched, &fresh);
+	}
+
+	return s_sched;
+}
+
+void wake_sched_set(wake_deadline_t id, uint32_t deadline)
+{
+	wake_sched_t *s = sched();
+
+	rtc_arena_begin(s);
+	s->deadline[id] = deadline;
+	rtc_arena_commit(s);
+}
+
+uint32_t wake_sched_get(wake_deadline_t id)
+{
+	return sched()->deadline[id];
+}
+
+/*
+ * Start the heartbeat grid on the cold boot, restart it when the period
+ * was shortened.
+ */
+static void heartbeat_check(wake_sched_t *s, uint32_t now)
+{
+	uint32_t period = settings_get()->safe_timer;
+
+	if (s->deadline[WAKE_HEARTBEAT] == 0 ||
+	    s->deadline[WAKE_HEARTBEAT] > now + period) {
+		rtc_arena_begin(s);
+		s->deadline[WAKE_HEARTBEAT] = now + period;
+		rtc_arena_commit(s);
+	}
+}
+
+uint32_t wake_sched_due()
+{
+	wake_sched_t *s = sched();
+	uint32_t now = time(NULL);
+	uint32_t period = settings_get()->safe_timer;
+	uint32_t due = 0;
+
+	heartbeat_check(s, now);
+	rtc_arena_begin(s);
+
+	/* the heartbeat is kept on the grid, it does not drift with wakes */
+	if (s->deadline[WAKE_HEARTBEAT] <= now) {
+		due |= WAKE_BIT(WAKE_HEARTBEAT);
+		s->deadline[WAKE_HEARTBEAT] += ((now -
+		    s->deadline[WAKE_HEARTBEAT]) / period + 1) * period;
+	}
+
+	for (int id = WAKE_HEARTBEAT + 1; id < WAKE_MAX; id++) {
+		if (s->deadline[id] != 0 && s->deadline[id] <= now) {
+			due |= WAKE_BIT(id);
+			s->deadline[id] = 0;
+		}
+	}
+
+	rtc_arena_commit(s);
+
+	return due;
+}
+
+uint64_t wake_sched_next()
+{
+	wake_sched_t *s = sched();
+	uint32_t now = time(NULL);
+	uint32_t next;
+
+	heartbeat_check(s, now);
+	next = s->deadline[WAKE_HEARTBEAT];
+
+	for (int id = WAKE_HEARTBEAT + 1; id < WAKE_MAX; id++) {
+		if (s->deadline[id] != 0 && s->deadline[id] < next) {
+			next = s->deadline[id];
+		}
+	}
+
+	if (next <= now) {
+		return MIN_SLEEP_US;
+	}
+
+	return (uint64_t)(next - now) * 1000000;
+}
+
+void wake_sched_arm()
+{
+	uint64_t next = wake_sched_next();
+
+	ESP_LOGI(__func__, "timer wake up in %llu s",
+	    (unsigned long long)next / 1000000);
+
+	esp_sleep_enable_timer_wakeup(next);
+}
+
+void wake_sched_shift_time(int32_t delta)
+{
+	wake_sched_t *s = sched();
+
+	rtc_arena_begin(s);
+
+	for (int id = 0; id < WAKE_MAX; id++) {
+		if (s->deadline[id] != 0) {
+			s->deadline[id] += delta;
+		}
+	}
+
+	rtc_arena_commit(s);
+}
@@ -0,0 +1,73 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef WAKE_SCHED_H
+#define WAKE_SCHED_H
+
+#include <stdint.h>
+
+typedef enum {
+	WAKE_HEARTBEAT,		/* periodic upload, settings safe_timer */
+	WAKE_FLUSH,		/* the oldest buffered sample gets stale */
+	WAKE_MAX
+} wake_deadline_t;
+
+#define WAKE_BIT(id) (1 << (id))
+
+/*
+ * Set the absolute deadline (unix time, s), 0 removes it.
+ */
+void wake_sched_set(wake_deadline_t id, uint32_t deadline);
+
+/*
+ * The deadline (unix time, s), 0 when not set.
+ */
+uint32_t wake_sched_get(wake_deadline_t id);
+
+/*
+ * Return the mask of the deadlines passed by now. The heartbeat moves to
+ * its next period on the fixed grid, the others are removed.
+ */
+uint32_t wake_sched_due(void);
+
+/*
+ * Time (us) until the earliest deadline.
+ */
+uint64_t wake_sched_next(void);
+
+/*
+ * Arm the timer wake up for the earliest deadline.
+ */
+void wake_sched_arm(void);
+
+/*
+ * Move all the deadlines, used when the clock was set.
+ */
+void wake_sched_shift_time(int32_t delta);
+
+#endif /* WAKE_SCHED_H */
@@ -0,0 +1,89 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "esp_wifi.h"
+#include "sdkconfig.h"
+
+#include "wifi_retry.h"
+
+
+void wifi_retry_init(wifi_retry_t *retry, int64_t now)
+{
+	retry->attempt = 0;
+	retry->start = now;
+}
+
+wifi_retry_action_t wifi_retry_next(wifi_retry_t *retry, uint8_t reason,
+    int64_t now, uint32_t rnd, uint32_t *delay_ms)
+{
+	wifi_retry_action_t action = WIFI_RETRY_DELAY;
+	int64_t left = (int64_t)CONFIG_WIFI_CONNECT_TIMEOUT -
+	    (now - retry->start) / 1000;
+	uint32_t base;
+
+	if (retry->attempt >= CONFIG_MAXIMUM_RETRY || left <= 0) {
+		return WIFI_RETRY_ABORT;
+	}
+
+	switch (reason) {
+		case WIFI_REASON_AUTH_FAIL:
+		case WIFI_REASON_802_1X_AUTH_FAILED:
+			/* wrong credentials, retrying only wastes the airtime */
+			return WIFI_RETRY_ABORT;
+		case WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT:
+		case WIFI_REASON_HANDSHAKE_TIMEOUT:
+			/* usually a wrong password too, allow one retry */
+			if (retry->attempt > 0) {
+				return WIFI_RETRY_ABORT;
+			}
+			break;
+		case WIFI_REASON_NO_AP_FOUND:
+			action = WIFI_RETRY_RESCAN;
+			break;
+		default:
+			break;
+	}
+
+	/* the shift is defined only for the attempts it cannot overflow */
+	if (retry->attempt >= 16 || ((uint32_t)CONFIG_WIFI_RETRY_BASE_MS <<
+	    retry->attempt) > CONFIG_WIFI_RETRY_MAX_MS) {
+		base = CONFIG_WIFI_RETRY_MAX_MS;
+	} else {
+		base = (uint32_t)CONFIG_WIFI_RETRY_BASE_MS << retry->attempt;
+	}
+
+	/* half of the delay is fixed, the other half random */
+	*delay_ms = base / 2 + rnd % (base / 2 + 1);
+	if (*delay_ms > left) {
+		*delay_ms = left;
+	}
+
+	retry->attempt++;
+
+	return action;
+}
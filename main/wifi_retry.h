@@ -0,0 +1,58 @@
+/*
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Robert David <robert.david@posteo.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef WIFI_RETRY_H
+#define WIFI_RETRY_H
+
+#include <stdint.h>
+
+typedef enum {
+	WIFI_RETRY_DELAY,	/* reconnect after the delay */
+	WIFI_RETRY_RESCAN,	/* scan all the channels after the delay */
+	WIFI_RETRY_ABORT	/* give up for this wake */
+} wifi_retry_action_t;
+
+typedef struct {
+	int attempt;
+	int64_t start;		/* us */
+} wifi_retry_t;
+
+/*
+ * Start a new connection, now is in us.
+ */
+void wifi_retry_init(wifi_retry_t *retry, int64_t now);
+
+/*
+ * Decide what to do after a disconnect with the given reason. The delay
+ * (ms) grows exponentially with the attempts, rnd jitters it, and it
+ * never crosses the total connection time limit.
+ */
+wifi_retry_action_t wifi_retry_next(wifi_retry_t *retry, uint8_t reason,
+    int64_t now, uint32_t rnd, uint32_t *delay_ms);
+
+#endif /* WIFI_RETRY_H */
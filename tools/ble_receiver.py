@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+#
+# Receive the BLE advertised samples (main/ble_adv.h) on a Linux host and
+# forward them to the influxdb server in the line protocol the WIFI
+# firmware uses.
+#
+#   ble_receiver.py scan --url http://192.168.1.1:8086 --db test \
+#       --site mysite --place myplace
+#
+# Scanning needs the bleak package and a BlueZ adapter. Without --url the
+# lines go to the standard output. The decode command reads the hex dumps
+# of the advertisement data, one per line, instead of scanning:
+#
+#   echo 0201060cffffff01... | ble_receiver.py decode
+#
+
+import argparse
+import struct
+import sys
+import time
+import urllib.request
+
+VERSION = 1
+PAYLOAD = struct.Struct("<HBHh3sB")
+MANUFACTURER_SPECIFIC = 0xff
+
+
+def manufacturer_data(adv):
+    """Manufacturer specific data of the raw advertisement, or None."""
+    pos = 0
+    while pos < len(adv) and adv[pos] != 0:
+        end = pos + 1 + adv[pos]
+        if end > len(adv):
+            return None
+        if adv[pos + 1] == MANUFACTURER_SPECIFIC:
+            return adv[pos + 2:end]
+        pos = end
+    return None
+
+
+def decode(data, company_id=0xffff):
+    """(seq, temp C, pres hPa, battery) of the payload, or None."""
+    if data is None or len(data) != PAYLOAD.size:
+        return None
+    company, version, seq, temp, pres, battery = PAYLOAD.unpack(data)
+    if company != company_id or version != VERSION:
+        return None
+    pres = int.from_bytes(pres, "little")
+    return seq, temp / 100, pres / 100, battery
+
+
+def lines(tag, sample, when):
+    """One line per field like the firmware, with the receive time."""
+    _, temp, pres, _ = sample
+    return ["%s temp=%0.2f %d" % (tag, temp, when),
+            "%s pres=%0.2f %d" % (tag, pres, when)]
+
+
+class Forwarder:
+    """Write the samples once, every advertisement is repeated."""
+
+    def __init__(self, args):
+        self.args = args
+        self.tag = "%s,site=%s,place=%s" % (args.meas, args.site, args.place)
+        self.last = {}
+
+    def sample(self, address, data, when):
+        sample = decode(data, self.args.company)
+        if sample is None or self.last.get(address) == sample[0]:
+            return
+        self.last[address] = sample[0]
+        self.write(lines(self.tag, sample, when))
+
+    def write(self, body):
+        body = "\n".join(body) + "\n"
+        if self.args.url is None:
+            sys.stdout.write(body)
+            sys.stdout.flush()
+            return
+        url = "%s/write?db=%s&precision=s" % (self.args.url, self.args.db)
+        try:
+            urllib.request.urlopen(url, body.encode(), timeout=10).close()
+        except OSError as e:
+            print("post failed: %s" % e, file=sys.stderr)
+
+
+def scan(forwarder):
+    import asyncio
+    from bleak import BleakScanner
+
+    def detected(device, adv):
+        for company, value in adv.manufacturer_data.items():
+            forwarder.sample(device.address,
+                             struct.pack("<H", company) + value,
+                             int(time.time()))
+
+    async def run():
+        async with BleakScanner(detected):
+            await asyncio.Event().wait()
+
+    asyncio.run(run())
+
+
+def decode_lines(forwarder, stream):
+    for n, line in enumerate(stream):
+        words = line.split()
+        if not words:
+            continue
+        data = manufacturer_data(bytes.fromhex(words[0]))
+        forwarder.sample("line%d" % n, data, int(time.time()))
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("command", choices=["scan", "decode"])
+    parser.add_argument("--url", help="influxdb server, print without it")
+    parser.add_argument("--db", default="test")
+    parser.add_argument("--meas", default="baro")
+    parser.add_argument("--site", default="mysite")
+    parser.add_argument("--place", default="myplace")
+    parser.add_argument("--company", type=lambda v: int(v, 0),
+                        default=0xffff, help="CONFIG_BLE_COMPANY_ID")
+    args = parser.parse_args()
+
+    forwarder = Forwarder(args)
+    if args.command == "scan":
+        scan(forwarder)
+    else:
+        decode_lines(forwarder, sys.stdin)
+
+
+if __name__ == "__main__":
+    main()
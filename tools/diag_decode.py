@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+#
+# Decode the diagnostic UART frames (main/diag.h) into a CSV trace.
+#
+#   stty -F /dev/ttyUSB1 raw 921600 && cat /dev/ttyUSB1 > capture.bin
+#   diag_decode.py capture.bin > trace.csv
+#
+# Every frame gives one "ulp" row with the latest ULP readings and one
+# "sample" row per buffered sample, stamped with the frame time.
+#
+#   diag_decode.py --replay capture.bin > host/energy/site.csv
+#
+# The replay prints the latest ULP readings of every frame as an energy
+# trace of host/test_energy.c: the seconds since the first frame, the
+# temperature and the pressure. A frame not later than the one before, a
+# reboot that lost the clock, is dropped.
+#
+
+import os
+import struct
+import sys
+import zlib
+
+SYNC = b"\xa5\x5a"
+VERSION = 1
+HEADER = struct.Struct("<BBHI")
+FIELD_NAMES = ["temp", "pres"]
+
+
+def field_names(fields):
+    return FIELD_NAMES[:fields] + [
+        "f%d" % i for i in range(len(FIELD_NAMES), fields)]
+
+
+def frames(data):
+    """Yield (time, fields, latest, samples) of every valid frame."""
+    pos = 0
+    while True:
+        pos = data.find(SYNC, pos)
+        if pos < 0 or pos + 2 + HEADER.size > len(data):
+            return
+        start = pos + 2
+        version, fields, count, now = HEADER.unpack_from(data, start)
+        sample = struct.Struct("<IHH%df" % (fields * 3))
+        size = HEADER.size + fields * 4 + count * sample.size
+        end = start + size
+        if version != VERSION or end + 4 > len(data):
+            pos += 1
+            continue
+        crc, = struct.unpack_from("<I", data, end)
+        if zlib.crc32(data[start:end]) != crc:
+            pos += 1
+            continue
+
+        off = start + HEADER.size
+        latest = struct.unpack_from("<%df" % fields, data, off)
+        off += fields * 4
+        samples = []
+        for i in range(count):
+            samples.append(sample.unpack_from(data, off))
+            off += sample.size
+        yield now, fields, latest, samples
+        pos = end + 4
+
+
+def replay(name, data):
+    start = last = None
+    for now, fields, latest, samples in frames(data):
+        if fields < 2:
+            sys.exit("%s: no pressure in the frames" % name)
+        if start is None:
+            start = now
+            print("# replayed from %s by diag_decode.py" % name)
+            print("# time (s), temp (C), pres (hPa)")
+        elif now <= last:
+            continue
+        last = now
+        print("%d,%.2f,%.2f" % (now - start, latest[0], latest[1]))
+
+
+def main():
+    args = sys.argv[1:]
+    mode = args.pop(0) if args and args[0] == "--replay" else None
+    if len(args) != 1:
+        sys.exit("usage: %s [--replay] capture" % sys.argv[0])
+
+    with open(args[0], "rb") as f:
+        data = f.read()
+
+    if mode == "--replay":
+        replay(os.path.basename(args[0]), data)
+        return
+
+    header = None
+    for now, fields, latest, samples in frames(data):
+        names = field_names(fields)
+        if header is None:
+            header = ["frame_time", "kind", "time", "count", "flags"]
+            for name in names:
+                header += [name, name + "_min", name + "_max"]
+            print(",".join(header))
+
+        row = [now, "ulp", now, 1, 0]
+        for v in latest:
+            row += ["%g" % v] * 3
+        print(",".join(map(str, row)))
+
+        for s in samples:
+            row = [now, "sample", s[0], s[1], s[2]]
+            row += ["%g" % v for v in s[3:]]
+            print(",".join(map(str, row)))
+
+
+if __name__ == "__main__":
+    main()
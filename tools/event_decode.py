@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+#
+# Render the binary event log lines "EVLOG:<hex>" of a serial console
+# capture with the formats from main/events.h.
+#
+#   event_decode.py console.log
+#   idf.py monitor | event_decode.py
+#
+
+import os
+import re
+import struct
+import sys
+import time
+
+EVENTS_H = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                        "..", "main", "events.h")
+EVENT = re.compile(r'EVENT\((\w+),\s*"((?:[^"\\]|\\.)*)"\)')
+ENTRY = struct.Struct("<IHHII")
+
+
+def formats(path):
+    """Event formats in the id order of the EVENTS list."""
+    with open(path) as f:
+        return [(m.group(1), m.group(2)) for m in EVENT.finditer(f.read())]
+
+
+def render(events, entry):
+    when, ev, _, a, b = entry
+    stamp = time.strftime("%Y-%m-%d %H:%M:%S", time.gmtime(when))
+    if ev >= len(events):
+        return "%s unknown event %u (%u, %u)" % (stamp, ev, a, b)
+    name, fmt = events[ev]
+    args = (a, b)[:fmt.count("%") - 2 * fmt.count("%%")]
+    return "%s %s: %s" % (stamp, name, fmt % args)
+
+
+def main():
+    events = formats(EVENTS_H)
+    src = open(sys.argv[1], errors="replace") if len(sys.argv) > 1 \
+        else sys.stdin
+
+    for line in src:
+        pos = line.find("EVLOG:")
+        if pos < 0:
+            continue
+        try:
+            data = bytes.fromhex(line[pos + 6:].strip())
+        except ValueError:
+            print("malformed EVLOG line", file=sys.stderr)
+            continue
+        for off in range(0, len(data) - ENTRY.size + 1, ENTRY.size):
+            print(render(events, ENTRY.unpack_from(data, off)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+#
+# Local stand-in of the influxdb /write endpoint for the QEMU runs and the
+# bench tests. The received lines go to the standard output, one request
+# per line of the log on the standard error.
+#
+#   influx_server.py --port 8086 > points.txt
+#   influx_server.py --settings "period=10" --fail 3
+#
+# --settings sends the settings delta (main/settings.h) in the first
+# successful response, --fail answers the first requests with an error to
+# exercise the retries.
+#
+
+import argparse
+import http.server
+import sys
+import time
+import urllib.parse
+
+SETTINGS_HEADER = "X-Sensor-Config"
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+
+    def do_POST(self):
+        url = urllib.parse.urlparse(self.path)
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        server = self.server
+
+        if url.path != "/write":
+            self.send_response(404)
+            self.end_headers()
+            return
+
+        server.requests += 1
+        if server.requests <= server.args.fail:
+            self.send_response(500)
+            self.end_headers()
+            return
+
+        lines = body.decode(errors="replace").splitlines()
+        sys.stdout.write("".join(line + "\n" for line in lines if line))
+        sys.stdout.flush()
+
+        self.send_response(204)
+        if server.settings is not None:
+            self.send_header(SETTINGS_HEADER, server.settings)
+            server.settings = None
+        self.end_headers()
+
+    def log_message(self, fmt, *args):
+        sys.stderr.write("%s %s %s\n" % (
+            time.strftime("%H:%M:%S"), self.address_string(), fmt % args))
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--port", type=int, default=8086)
+    parser.add_argument("--settings", help="settings delta to send once")
+    parser.add_argument("--fail", type=int, default=0,
+                        help="requests to answer with 500")
+    args = parser.parse_args()
+
+    server = http.server.HTTPServer(("", args.port), Handler)
+    server.args = args
+    server.settings = args.settings
+    server.requests = 0
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,48 @@
+#!/bin/sh
+#
+# Build the QEMU variant (sdkconfig.qemu), run it in the Espressif QEMU
+# against the influxdb stand-in of influx_server.py and print the boot
+# times the firmware logs on every wake.
+#
+#   . $IDF_PATH/export.sh
+#   tools/qemu_run.sh [seconds]
+#
+# The serial output goes to build-qemu/serial.log, the received lines to
+# build-qemu/points.txt.
+#
+
+set -e
+
+TOOLS=$(cd "$(dirname "$0")" && pwd)
+BUILD=build-qemu
+PORT=8086
+SECONDS_RUN=${1:-60}
+
+cd "$TOOLS/.."
+
+idf.py -B $BUILD -D SDKCONFIG=$BUILD/sdkconfig \
+    -D SDKCONFIG_DEFAULTS="$TOOLS/sdkconfig.qemu" build
+(cd $BUILD && esptool.py --chip esp32 merge_bin --fill-flash-size 4MB \
+    -o flash.bin @flash_args)
+
+python3 "$TOOLS/influx_server.py" --port $PORT > $BUILD/points.txt &
+SERVER=$!
+trap 'kill $SERVER' EXIT
+
+timeout "$SECONDS_RUN" qemu-system-xtensa -nographic -machine esp32 \
+    -drive file=$BUILD/flash.bin,if=mtd,format=raw \
+    -nic user,model=open_eth > $BUILD/serial.log || true
+
+# "power up to app_main N us" or "wake stub to app_main N us" on the RTC
+# timer, then "app_main to sleep M us" on esp_timer
+awk '/ to app_main / {
+	boot += $(NF - 1); nboot++
+} /app_main to sleep/ {
+	run += $(NF - 1); n++
+} END {
+	if (n == 0) { print "no wake logged"; exit 1 }
+	printf "%d wakes, reset to app_main %d us (%d measured), " \
+	    "app_main to sleep %d us\n", n, nboot ? boot / nboot : 0,
+	    nboot, run / n
+}' $BUILD/serial.log
+echo "$(wc -l < $BUILD/points.txt) points received"